@@ -0,0 +1,12 @@
+// Naive recursive Fibonacci: nothing but calls, compares and adds (not const, so it runs every time).
+// prints 2178309.
+fib(n) {
+   if n < 2 { return n; }
+   return fib(n - 1) + fib(n - 2);
+}
+
+main() {
+   write(fib(32));
+   putch(10);
+   return 0;
+}
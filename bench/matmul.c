@@ -0,0 +1,52 @@
+// Matrix multiply, n x n row major in flat arrays: the inner loop is a dot product with a strided operand.
+// prints the checksum of the product.
+const N = 200;
+
+main() {
+   let a[N * N];
+   let b[N * N];
+   let c[N * N];
+   let i;
+   i = 0;
+   loop {
+       if i == N * N { break; }
+       a[i] = i % 7 - 3;
+       b[i] = i % 5 + 1;
+       i = i + 1;
+   }
+
+   let row;
+   row = 0;
+   loop {
+       if row == N { break; }
+       let col;
+       col = 0;
+       loop {
+           if col == N { break; }
+           let sum;
+           sum = 0;
+           let k;
+           k = 0;
+           loop {
+               if k == N { break; }
+               sum = sum + a[row * N + k] * b[k * N + col];
+               k = k + 1;
+           }
+           c[row * N + col] = sum;
+           col = col + 1;
+       }
+       row = row + 1;
+   }
+
+   let checksum;
+   checksum = 0;
+   i = 0;
+   loop {
+       if i == N * N { break; }
+       checksum = checksum * 31 + c[i];
+       i = i + 1;
+   }
+   write(checksum);
+   putch(10);
+   return 0;
+}
@@ -0,0 +1,13 @@
+// I/O heavy: a number and a newline per line, 300000 lines through write/putch.
+// prints 0 to 299999, one per line.
+main() {
+   let i;
+   i = 0;
+   loop {
+       if i == 300000 { break; }
+       write(i * 2 - i);
+       putch(10);
+       i = i + 1;
+   }
+   return 0;
+}
@@ -0,0 +1,58 @@
+// Array scans: reductions, searches and the len/fill/copy/equal builtins over a million elements.
+// prints the sum, min, max and match count, then how many copies compared equal.
+scan(a[0], needle) {
+   let sum;
+   sum = 0;
+   let lo;
+   lo = a[0];
+   let hi;
+   hi = a[0];
+   let found;
+   found = 0;
+   let i;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       let x;
+       x = a[i];
+       sum = sum + x;
+       if x < lo { lo = x; }
+       if x > hi { hi = x; }
+       found = found + (x == needle);
+       i = i + 1;
+   }
+   return sum ^ lo * 7 ^ hi * 13 ^ found;
+}
+
+main() {
+   let a[1000000];
+   let b[1000000];
+   let i;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       a[i] = (i * 7919) % 10007 - 5000;
+       i = i + 1;
+   }
+
+   let result;
+   result = 0;
+   let same;
+   same = 0;
+   let round;
+   round = 0;
+   loop {
+       if round == 20 { break; }
+       result = result + scan(a, round * 100);
+       copy(b, a);
+       same = same + equal(a, b);
+       fill(b, round);
+       same = same + equal(a, b);
+       round = round + 1;
+   }
+   write(result);
+   putch(32);
+   write(same);
+   putch(10);
+   return 0;
+}
@@ -0,0 +1,50 @@
+// Sieve of Eratosthenes: strided stores over a big array, counted 10 times over.
+// prints 1489330 (148933 primes below 2000000, 10 times).
+sieve(flags[0]) {
+   let n;
+   n = len(flags);
+   fill(flags, 1);
+   flags[0] = 0;
+   flags[1] = 0;
+   let i;
+   i = 2;
+   loop {
+       if i * i >= n { break; }
+       if flags[i] {
+           let j;
+           j = i * i;
+           loop {
+               if j >= n { break; }
+               flags[j] = 0;
+               j = j + i;
+           }
+       }
+       i = i + 1;
+   }
+
+   let count;
+   count = 0;
+   i = 0;
+   loop {
+       if i == n { break; }
+       count = count + flags[i];
+       i = i + 1;
+   }
+   return count;
+}
+
+main() {
+   let flags[2000000];
+   let total;
+   total = 0;
+   let round;
+   round = 0;
+   loop {
+       if round == 10 { break; }
+       total = total + sieve(flags);
+       round = round + 1;
+   }
+   write(total);
+   putch(10);
+   return 0;
+}
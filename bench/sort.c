@@ -0,0 +1,66 @@
+// Quicksort of pseudo random numbers: recursion, data dependent branches and swaps.
+// prints 1 (sorted) then the checksum of the sorted array.
+let seed;
+
+random() {
+   seed = seed * 1103515245 + 12345;
+   return (seed >> 8) & 1048575;
+}
+
+quicksort(a[0], lo, hi) {
+   loop {
+       if hi - lo < 1 { break; }
+       let pivot;
+       pivot = a[(lo + hi) / 2];
+       let i;
+       i = lo;
+       let j;
+       j = hi;
+       loop {
+           if i > j { break; }
+           loop { if a[i] >= pivot { break; } i = i + 1; }
+           loop { if a[j] <= pivot { break; } j = j - 1; }
+           if i <= j {
+               let t;
+               t = a[i];
+               a[i] = a[j];
+               a[j] = t;
+               i = i + 1;
+               j = j - 1;
+           }
+       }
+       quicksort(a, lo, j); // the smaller half would bound the depth, but inputs are random.
+       lo = i;
+   }
+   return 0;
+}
+
+main() {
+   seed = 42;
+   let a[300000];
+   let i;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       a[i] = random();
+       i = i + 1;
+   }
+   quicksort(a, 0, len(a) - 1);
+
+   let sorted;
+   sorted = 1;
+   let checksum;
+   checksum = 0;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       if i > 0 && a[i - 1] > a[i] { sorted = 0; }
+       checksum = checksum * 31 + a[i];
+       i = i + 1;
+   }
+   write(sorted);
+   putch(32);
+   write(checksum);
+   putch(10);
+   return 0;
+}
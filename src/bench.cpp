@@ -0,0 +1,188 @@
+// bench.cpp
+//
+// Run time benchmarks of the code the compiler generates: every program (../bench/*.c) is compiled at each
+// optimization level for each backend and run a few times, the median wall time is compared to a baseline file.
+//
+//     ./bench [-n runs] [-c compiler] [-r runtime.cpp] [-b baseline] [-t percent] [--save] file.c...
+//
+// Backends:
+//     native  the compiler's bitcode at -O<n>, through clang's backend at -O<n> with clang's own IR passes off, so
+//             the IR is the compiler's. The binary's size is reported too.
+//     jit     --run --hot 0 -O<n>: every function is JIT compiled on its first call (compile time included).
+//     tiered  --run -O<n> with the default --hot: interpreted until hot, then native (on-stack replacement included).
+//     vm      --run --no-jit: the bytecode interpreter, the level doesn't apply.
+//
+// Every configuration has to print what the first one printed. Against the baseline (default
+// ../bench/baseline.txt) a median more than -t percent (default 10) slower is marked and makes the exit status 1;
+// --save writes this run's numbers as the new baseline instead. Times are only comparable on the same machine,
+// so the baseline is not shared: make one with --save before changing codegen.
+//
+// Baseline lines: 'program backend level median_us size'.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+struct Config { const char *backend; int level; };
+static const Config configs[] = {
+    {"native", 0}, {"native", 1}, {"native", 2}, {"native", 3},
+    {"jit", 0},    {"jit", 1},    {"jit", 2},    {"jit", 3},
+    {"tiered", 2},
+    {"vm", -1},
+};
+
+struct Result { long long median_us; long long size; };
+
+// Runs argv with stdout to 'out' (unless null), returns its exit status (-1 if it couldn't run or was killed).
+static int run(const std::vector<std::string>& args, const char *out)
+{
+    std::vector<char *> argv;
+    for (auto& a : args) { argv.push_back((char *)a.c_str()); }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (out) { posix_spawn_file_actions_addopen(&actions, 1, out, O_WRONLY | O_CREAT | O_TRUNC, 0644); }
+    pid_t pid;
+    int status = -1;
+    if (posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0) { waitpid(pid, &status, 0); }
+    posix_spawn_file_actions_destroy(&actions);
+    return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static std::string slurp(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5;
+    double threshold = 10;
+    bool save = false;
+    std::string compiler = "./a.out", runtime = "runtime.cpp", baseline_path = "../bench/baseline.txt";
+    std::vector<std::string> programs;
+    for (int i = 1; i < argc; ++i)
+    {
+        if      (!strcmp(argv[i], "-n") && i + 1 < argc) { runs = std::max(1, atoi(argv[++i])); }
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc) { compiler = argv[++i]; }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc) { runtime = argv[++i]; }
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) { baseline_path = argv[++i]; }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) { threshold = atof(argv[++i]); }
+        else if (!strcmp(argv[i], "--save"))              { save = true; }
+        else    { programs.push_back(argv[i]); }
+    }
+    if (programs.empty()) { fprintf(stderr, "usage: %s [-n runs] [-c compiler] [-r runtime.cpp] [-b baseline] [-t percent] [--save] file.c...\n", argv[0]); return 2; }
+    const char *cxx = getenv("CXX") ? getenv("CXX") : "clang++";
+
+    std::map<std::string, Result> baseline; // by 'program backend level'.
+    if (FILE *in = fopen(baseline_path.c_str(), "r"))
+    {
+        char program[4096], backend[64];
+        int level;
+        Result r;
+        while (fscanf(in, "%4095s %63s %d %lld %lld", program, backend, &level, &r.median_us, &r.size) == 5)
+        {
+            baseline[std::string(program) + " " + backend + " " + std::to_string(level)] = r;
+        }
+        fclose(in);
+    }
+
+    char dir_template[] = "/tmp/complier-bench.XXXXXX";
+    if (!mkdtemp(dir_template)) { fprintf(stderr, "can't make a temporary directory\n"); return 1; }
+    std::string dir = dir_template;
+    std::string runtime_o = dir + "/runtime.o", bc = dir + "/main.bc", elf = dir + "/main.elf", out = dir + "/out.txt";
+    if (run({cxx, "-O2", "-c", runtime, "-o", runtime_o}, nullptr)) { fprintf(stderr, "can't compile %s\n", runtime.c_str()); return 1; }
+
+    printf("%-14s %-7s %5s %12s %10s %12s %8s\n", "program", "backend", "level", "median ms", "size", "baseline ms", "change");
+    std::vector<std::string> saved;
+    bool failed = false, regressed = false;
+    for (auto& program : programs)
+    {
+        std::string name = std::filesystem::path(program).stem();
+        std::string expected;
+        bool first = true;
+        for (const Config& c : configs)
+        {
+            std::string level = "-O" + std::to_string(c.level);
+            std::string shown = c.level < 0 ? "-" : std::to_string(c.level);
+            std::vector<std::string> command;
+            long long size = 0;
+            if (!strcmp(c.backend, "native"))
+            {
+                if (run({compiler, "-q", level, "-o", bc, program}, nullptr) ||
+                    run({cxx, level, "-Xclang", "-disable-llvm-passes", bc, runtime_o, "-o", elf, "-lpthread"}, nullptr))
+                {
+                    printf("%-14s %-7s %5s  compile FAILED\n", name.c_str(), c.backend, shown.c_str());
+                    failed = true;
+                    continue;
+                }
+                size = (long long)std::filesystem::file_size(elf);
+                command = {elf};
+            }
+            else if (!strcmp(c.backend, "jit"))    { command = {compiler, "--run", "--hot", "0", "--no-jit-cache", level, program}; }
+            else if (!strcmp(c.backend, "tiered")) { command = {compiler, "--run", "--no-jit-cache", level, program}; }
+            else                                { command = {compiler, "--run", "--no-jit", program}; }
+
+            std::vector<long long> times;
+            bool wrong = false;
+            for (int i = 0; i < runs && !wrong; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                int status = run(command, out.c_str());
+                times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                std::string output = slurp(out);
+                if (first) { expected = output; first = false; }
+                wrong = status != 0 || output != expected; // main returns 0 in every benchmark.
+            }
+            if (wrong)
+            {
+                printf("%-14s %-7s %5s  WRONG OUTPUT\n", name.c_str(), c.backend, shown.c_str());
+                failed = true;
+                continue;
+            }
+
+            std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+            Result r{times[times.size() / 2], size};
+            std::string key = name + " " + c.backend + " " + std::to_string(c.level);
+            saved.push_back(key + " " + std::to_string(r.median_us) + " " + std::to_string(r.size));
+
+            printf("%-14s %-7s %5s %12.2f %10s ", name.c_str(), c.backend, shown.c_str(), r.median_us / 1000.0, size ? std::to_string(size).c_str() : "-");
+            auto found = baseline.find(key);
+            if (found == baseline.end() || !found->second.median_us) { printf("%12s %8s\n", "-", "-"); continue; }
+            double change = 100.0 * (r.median_us - found->second.median_us) / found->second.median_us;
+            bool slower = change > threshold;
+            regressed |= slower;
+            printf("%12.2f %+7.1f%%%s", found->second.median_us / 1000.0, change, slower ? "  SLOWER" : "");
+            if (r.size && found->second.size && r.size != found->second.size) { printf("  (size %+lld)", r.size - found->second.size); }
+            printf("\n");
+        }
+    }
+    std::filesystem::remove_all(dir);
+
+    if (save)
+    {
+        FILE *os = fopen(baseline_path.c_str(), "w");
+        if (!os) { fprintf(stderr, "can't write %s\n", baseline_path.c_str()); return 1; }
+        for (auto& line : saved) { fprintf(os, "%s\n", line.c_str()); }
+        fclose(os);
+        printf("baseline written to %s\n", baseline_path.c_str());
+        return failed;
+    }
+    return failed || regressed;
+}
@@ -0,0 +1,78 @@
+// client.cpp
+//
+// Thin client for the compile server (server.cpp). No LLVM, so it starts instantly.
+//
+//     ./complier file.c [-o out] [-m obj|bc|ll] [-s socket] [compiler options]
+//
+// Defaults: -m obj, -o main.o (main.bc / main.ll for the other modes), -s /tmp/complier.sock.
+// Compiler options are passed on to the server: -O<n>, -g, --no-ast-opt, --stack-limit <bytes>, --profile,
+// --profile-loops.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "tools.hpp"
+
+int main(int argc, char **argv)
+{
+    const char *input = nullptr, *output = nullptr, *mode = "obj", *path = "/tmp/complier.sock";
+    std::vector<std::string> options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if      (!strcmp(argv[i], "-o") && i + 1 < argc) { output = argv[++i]; }
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc) { mode   = argv[++i]; }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) { path   = argv[++i]; }
+        else if (!strcmp(argv[i], "--stack-limit") && i + 1 < argc) { options.push_back(argv[i]); options.push_back(argv[++i]); }
+        else if (argv[i][0] == '-') { options.push_back(argv[i]); } // the server says if it doesn't know one.
+        else    { input = argv[i]; }
+    }
+    if (!input) { fprintf(stderr, "usage: %s file.c [-o out] [-m obj|bc|ll] [-s socket] [compiler options]\n", argv[0]); return 2; }
+    options.push_back("--source");
+    options.push_back(input);
+    if (!output) { output = !strcmp(mode, "bc") ? "main.bc" : !strcmp(mode, "ll") ? "main.ll" : "main.o"; }
+
+    std::vector<unsigned char> text = my_tools::read_file(input);
+    if (text.empty()) { fprintf(stderr, "can't read %s\n", input); return 1; }
+    text.pop_back(); // the server adds its own terminator.
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) { fprintf(stderr, "can't connect to %s: %s\n", path, strerror(errno)); return 1; }
+
+    std::string request = std::string(mode) + "\n";
+    for (auto& option : options) { request += option + "\n"; }
+    request += "\n"; // end of the header.
+    request.append(text.begin(), text.end());
+    for (size_t done = 0; done < request.size();)
+    {
+        ssize_t n = write(fd, request.data() + done, request.size() - done);
+        if (n <= 0) { fprintf(stderr, "write: %s\n", strerror(errno)); return 1; }
+        done += n;
+    }
+    shutdown(fd, SHUT_WR); // end of request.
+
+    std::vector<char> response;
+    char buf[1 << 16];
+    for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;) { response.insert(response.end(), buf, buf + n); }
+    close(fd);
+
+    if (response.empty() || response[0] != 'O')
+    {
+        fwrite(response.data(), 1, response.size(), stderr);
+        if (response.empty()) { fprintf(stderr, "compile failed\n"); }
+        return 1;
+    }
+
+    FILE *out = fopen(output, "wb");
+    if (!out) { fprintf(stderr, "can't write %s\n", output); return 1; }
+    fwrite(response.data() + 1, 1, response.size() - 1, out);
+    fclose(out);
+    return 0;
+}
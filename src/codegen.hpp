@@ -1,3 +1,10 @@
+// codegen.hpp
+
+#ifndef CODEGEN_HPP
+#define CODEGEN_HPP
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
@@ -5,30 +12,135 @@
 #include "llvm/TargetParser/Host.h"
 #include "llvm/TargetParser/Triple.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/NoFolder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <string> 
 #include <vector>
 #include "tools.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "optimizer.hpp"
+#include "passes.hpp"
+#include "report.hpp"
+#include "queue.hpp"
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <thread>
 
 namespace llvm 
 {
 
+    // What the Compiler does with the module once it is generated.
+    struct Options
+    {
+        bool print_ir = true;            // print the module to stdout.
+        std::string output = "main.bc";  // bitcode file written on destruction ("" to skip, eg. when using emit_*()).
+
+        // Streaming: codegen each function as soon as it is parsed and free its AST right away,
+        // instead of parsing the whole Program first and keeping it alive.
+        bool streaming = false;
+        bool pipelined = false;          // like streaming, but parsing runs on its own thread, overlapped with codegen.
+        unsigned opt_level = 0;          // run the -O<n> function simplification pipeline on each function once generated.
+        std::string split;               // emit each function to '<split>.<n>.o' as soon as it's done and drop its body from the module.
+        bool ast_passes = true;          // run the AST passes (passes.hpp) on each function before codegen.
+        bool pass_stats = false;         // print what the AST passes did and how long they took to stderr.
+
+        // Report mode: per-function IR statistics to stderr and LLVM's optimization remarks to this YAML file.
+        // Unless splitting, the whole -O<n> module pipeline then runs once at the end instead of per function,
+        // so inlining and vectorization get reported too.
+        std::string report;
+
+        // Instrument every function with call counts and rdtsc cycle accounting (runtime.cpp writes prof.out at exit,
+        // prof_report prints it), and with profile_loops also count the trips of every loop.
+        bool profile = false;
+        bool profile_loops = false;
+
+        // Arrays of a literal size above this many bytes don't go in the stack frame but in the thread's arena
+        // (allocated once per call, so recursion and threads are fine). frame_report prints the biggest frames.
+        uint64_t stack_limit = 16 << 10;
+        bool frame_report = false;
+
+        // DWARF line tables (-g): a subprogram for every function and par body, a location for every statement,
+        // so profilers and debuggers map addresses back to lines of 'source'.
+        bool debug_info = false;
+        std::string source = "main.c";
+    };
+
+
+    // TargetMachine for the host, created once and reused for every module (eg. by the compile server).
+    // Needs InitializeNativeTarget() and InitializeNativeTargetAsmPrinter() first.
+    static std::unique_ptr<TargetMachine> host_target_machine()
+    {
+        std::string triple = Triple(sys::getDefaultTargetTriple()).str();
+        std::string error;
+        const Target *target = TargetRegistry::lookupTarget(triple, error);
+        if (!target) { ABORT("No target for " << triple << ": " << error); }
+
+        return std::unique_ptr<TargetMachine>(target->createTargetMachine(triple, sys::getHostCPUName(), "", TargetOptions(), Reloc::PIC_));
+    }
+
+
     struct Compiler
     {
-        Compiler(my_lexer::u8 *text) :
-            prog(my_parser::Parser{text}()),
+        // Names are interned in ids, which whoever reads them back (eg. the VM) has to share.
+        Compiler(my_lexer::u8 *text, my_lexer::Interner& ids, Options opts = {}) :
+            opts(std::move(opts)),
+            ids(ids),
+            prog(this->opts.streaming || this->opts.pipelined ? my_parser::Program{} : my_parser::Parser{text, ids}()),
             ctx(),
             mod("main.cpp", ctx),
-            builder(ctx)
+            builder(ctx),
+            passes(ids),
+            consts(ids)
         {
+            my_memstats::Scope phase{my_memstats::CODEGEN}; // parsing, passes and optimizing have their own.
+            my_memstats::checkpoint(this->opts.streaming || this->opts.pipelined ? my_memstats::OTHER : my_memstats::PARSE);
             mod.setTargetTriple(Triple(sys::getDefaultTargetTriple()).str());
             setup();
-            gen_prog(prog);
+
+            if (this->opts.opt_level) { optimizer.emplace(this->opts.opt_level); }
+            if (!this->opts.report.empty()) { report.emplace(); report->attach(ctx, this->opts.report); }
+            if (!this->opts.split.empty())
+            {
+                InitializeNativeTarget();
+                InitializeNativeTargetAsmPrinter();
+                split_tm = host_target_machine();
+                mod.setDataLayout(split_tm->createDataLayout());
+            }
+
+            if (this->opts.pipelined)      { gen_pipelined(text); }
+            else if (!this->opts.streaming) { gen_prog(prog); }
+            else
+            {
+                // Only one function's AST is alive at a time.
+                my_parser::Parser{text, ids}([&](my_parser::TopLevel&& item) {
+                    item(
+                        [&](my_parser::Func& f)   { run_passes(f); declare_const(f); finish_function(gen_function(f)); },
+                        [&](my_parser::Global& g) { gen_global(g); }
+                    );
+                });
+            }
+
+            if (this->opts.profile) { finish_profile(); }
+            if (dib) { dib->finalize(); }
+            // The resident set of everything per function (parsing when streaming, AST passes, optimizing) is
+            // codegen's, only the whole module pipeline of report mode is a step of its own.
+            my_memstats::checkpoint(my_memstats::CODEGEN);
+            if (report) { finish_report(); my_memstats::checkpoint(my_memstats::OPTIMIZE); }
         }
 
         ~Compiler()
@@ -37,25 +149,78 @@ namespace llvm
             // users write returns now..
             // builder.CreateRet(builder.getInt32(0));
 
-            if constexpr (true) { mod.print(outs(), 0); }
+            my_memstats::Scope phase{my_memstats::EMIT};
+            if (opts.pass_stats) { passes.report(std::cerr); }
+            if (opts.frame_report) { print_frames(errs()); }
+            if (opts.print_ir) { mod.print(outs(), 0); }
 
-            if (verifyModule(mod, &errs())) { ABORT("Module verification failed"); }
+            if (opts.output.empty()) { my_memstats::checkpoint(my_memstats::EMIT); return; }
+
+            verify();
 
             std::error_code error_opening_file;
-            raw_fd_ostream file("main.bc", error_opening_file);
-            if (error_opening_file) { ABORT("error writing to main.bc: " << error_opening_file); }
+            raw_fd_ostream file(opts.output, error_opening_file);
+            if (error_opening_file) { ABORT("error writing to " << opts.output << ": " << error_opening_file); }
             WriteBitcodeToFile(mod, file);
+            my_memstats::checkpoint(my_memstats::EMIT);
+        }
+
+        void verify()
+        {
+            if (verifyModule(mod, &errs())) { ABORT("Module verification failed"); }
+        }
+
+        void emit_bitcode(raw_ostream& os) { my_memstats::Scope phase{my_memstats::EMIT}; verify(); WriteBitcodeToFile(mod, os); my_memstats::checkpoint(my_memstats::EMIT); }
+
+        void emit_ir(raw_ostream& os) { my_memstats::Scope phase{my_memstats::EMIT}; verify(); mod.print(os, 0); my_memstats::checkpoint(my_memstats::EMIT); }
+
+        // Native object code for tm's target.
+        void emit_object(raw_pwrite_stream& os, TargetMachine& tm)
+        {
+            my_memstats::Scope phase{my_memstats::EMIT};
+            verify();
+            mod.setDataLayout(tm.createDataLayout());
+
+            legacy::PassManager pm;
+            if (tm.addPassesToEmitFile(pm, os, nullptr, CodeGenFileType::ObjectFile)) { ABORT("Target can't emit object files"); }
+            pm.run(mod);
+            my_memstats::checkpoint(my_memstats::EMIT);
         }
         
         private:
+            Options opts;
+            my_lexer::Interner& ids;
             my_parser::Program prog;
             LLVMContext ctx;
             Module mod;
             IRBuilder<NoFolder> builder;
+            std::optional<Optimizer> optimizer;         // set when opts.opt_level > 0.
+            std::optional<Report> report;               // set when opts.report is used.
+            my_passes::Pipeline passes;                 // AST passes, run on each function before its codegen.
+            my_passes::Interpreter consts;              // evaluates const function calls in globals.
+            std::unique_ptr<TargetMachine> split_tm;    // set when opts.split is used.
+            int split_count = 0;
             std::unordered_map<std::string, Function *> functions;
             std::unordered_map<std::string, Value *> formats;
 
             std::vector<BasicBlock*> continue_stack, break_stack;
+            int par_depth = 0;  // > 0 while generating an outlined par body (return is not allowed there).
+            int par_count = 0;  // used to give every outlined par body a unique name.
+            std::vector<Function*> par_bodies; // outlined from the function being generated, handed to finish_function.
+            Value *arena_mark = nullptr; // __arena_mark() taken at entry of the current function if it allocates from the arena.
+
+            std::unique_ptr<DIBuilder> dib;     // set when opts.debug_info is used.
+            DIFile *di_file = nullptr;
+            DISubprogram *di_scope = nullptr;   // of the function (or par body) being generated.
+
+            struct Frame { uint64_t bytes = 0, arrays = 0, promoted = 0; };
+            std::map<std::string, Frame> frames; // static frame of every function (and par body), for opts.frame_report.
+
+            StructType *prof_type = nullptr;           // runtime.cpp's ProfRecord {ptr name, i64 calls, cycles, self, i32 loops, ptr trips}.
+            GlobalVariable *prof_record = nullptr;     // record of the function being generated (null in par bodies: no exit hook).
+            GlobalVariable *prof_trips = nullptr;      // its loop trip counters, sized once the function is done.
+            unsigned prof_loops = 0;
+            std::vector<GlobalVariable *> prof_records;
 
 
 
@@ -67,10 +232,12 @@ namespace llvm
                 {
                     Value *alloca; // mem location of var/arr
                     bool is_array; // var or arr ?
+                    Value *length = nullptr; // arrays: number of elements (i32), so arrays are passed around as slices.
+                    bool is_const = false;   // module level const: can't be assigned (scalars are their initializer).
                 };
 
 
-                SymbolTable() { ++(*this); } // Global scope is a scope and must track.
+                SymbolTable(my_lexer::Interner& ids) : ids(ids) { ++(*this); } // Global scope is a scope and must track.
 
                 void operator++() { tables.push_back({}); } // push scope to stack.
                 void operator--() { tables.pop_back();    } // pop scope from stack.
@@ -84,15 +251,28 @@ namespace llvm
                     }
 
                     // Search did not find variable/array.
-                    ABORT("Failed to find symbol " << my_lexer::ids[name]);
+                    ABORT("Failed to find symbol " << ids[name]);
                 }
                 
-                void push(my_lexer::i32 name, Value *alloca, bool is_array) { tables.back()[name] = {alloca, is_array}; } // pushing variables/arrays in tables/scopes.
+                void push(my_lexer::i32 name, Value *alloca, bool is_array, Value *length = nullptr, bool is_const = false) { tables.back()[name] = {alloca, is_array, length, is_const}; } // pushing variables/arrays in tables/scopes.
+
+                // Every symbol visible from the current scope except the global scope (inner scopes shadow outer ones).
+                // Used to capture the enclosing function's variables when outlining a par body.
+                std::vector<std::pair<my_lexer::i32, Symbol>> locals()
+                {
+                    std::unordered_map<my_lexer::i32, Symbol> seen;
+                    for (size_t i = tables.size() - 1 ; i > 0 ; --i)
+                    {
+                        for (auto& [name, symbol] : tables[i]) { seen.try_emplace(name, symbol); }
+                    }
+                    return {seen.begin(), seen.end()};
+                }
 
                 private:
+                    my_lexer::Interner& ids; // for the names in errors.
                     std::vector<std::unordered_map<my_lexer::i32, Symbol>> tables; // a vector of scopes. outer index scope level. inner index var name.
 
-            } symbols; // declare a SymbolTable named 'symbols'
+            } symbols{ids}; // declare a SymbolTable named 'symbols'
 
 
 
@@ -107,31 +287,210 @@ namespace llvm
             }
 
 
-            void gen_prog(my_parser::Program& p) { for(auto& f : p.body) { gen_function(f); } }
+            void gen_prog(my_parser::Program& p)
+            {
+                for(auto& f : p.body) { declare_const(f); } // globals may call them.
+                for(auto& g : p.globals) { gen_global(g); }
+                if (opts.ast_passes) { my_memstats::Scope phase{my_memstats::PASSES}; passes.declare(p); }
+                for(auto& f : p.body) { run_passes(f); finish_function(gen_function(f)); }
+            }
 
 
 
-            // struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; }; // params variable or array (value).
-            // struct Variable { my_lexer::i32 name; }; 
-            void gen_function(my_parser::Func& f)
+            // Module level 'let' and 'const', in the global scope of the symbol table.
+            // Globals are internal, so they can't clash with C symbols and the optimizer sees every use
+            // (with --split they are external instead, so every part shares the one defined in the main module).
+            // A const is a constant global (arrays end up in .rodata), and its scalar uses are replaced by the value.
+            void gen_global(my_parser::Global& g)
             {
-                //{ 
-                //    FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), {}, false);
-                //    functions["main"] = Function::Create(sig, GlobalValue::ExternalLinkage, "main", mod);
-                //    BasicBlock *block = BasicBlock::Create(ctx, "entry", functions["main"]);
-                //    builder.SetInsertPoint(block);
-                //}
+                std::string name = std::string(ids[g.name]);
+                GlobalValue::LinkageTypes linkage = opts.split.empty() || g.is_const ? GlobalValue::InternalLinkage : GlobalValue::ExternalLinkage;
 
+                std::vector<uint32_t> values;
+                for (auto& e : g.init) { values.push_back((uint32_t)const_value(e)); }
 
-                // std::unordered_map<std::string, Function *> functions; (tracking functions with strings).
+                if (!g.is_array)
+                {
+                    if (g.is_const) { consts.constants[g.name] = values.empty() ? 0 : (my_lexer::i32)values[0]; } // for const functions.
+                    Constant *init = builder.getInt32(values.empty() ? 0 : values[0]);
+                    auto *gv = new GlobalVariable(mod, builder.getInt32Ty(), g.is_const, linkage, init, name);
+                    symbols.push(g.name, gv, false, nullptr, g.is_const);
+                    return;
+                }
 
-                // struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; };
-                // get the name of function 
-                std::string name = std::string(my_lexer::ids[f.name]);
+                my_lexer::i32 length = g.size ? const_value(*g.size) : (my_lexer::i32)values.size();
+                if (length <= 0) { ABORT("Array " << name << " has size " << length); }
+                if (values.size() > (size_t)length) { ABORT("Too many initializers for " << name << "[" << length << "]"); }
+                values.resize(length, 0);
+
+                auto *gv = new GlobalVariable(mod, ArrayType::get(builder.getInt32Ty(), length), g.is_const, linkage, ConstantDataArray::get(ctx, values), name);
+                if (g.is_const) { gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global); }
+                symbols.push(g.name, gv, true, builder.getInt32(length), g.is_const);
+            }
+
+            // Const functions seen so far, for the initializers and sizes of globals.
+            void declare_const(my_parser::Func& f) { if (f.is_const) { consts.functions.insert_or_assign(f.name, f); } }
+
+            // Value of a constant expression: literals, operators, earlier const scalars and calls of const functions.
+            my_lexer::i32 const_value(my_parser::Expr e)
+            {
+                struct Substitute : my_passes::Visitor<Substitute>
+                {
+                    SymbolTable& symbols;
+                    my_lexer::Interner& ids;
+                    Substitute(SymbolTable& symbols, my_lexer::Interner& ids) : symbols(symbols), ids(ids) {}
+                    void leave_expr(my_parser::Expr& e)
+                    {
+                        auto *v = std::get_if<my_parser::Variable>(&e);
+                        if (!v) { return; }
+                        auto symbol = symbols[v->name];
+                        if (!symbol.is_const || symbol.is_array) { ABORT(ids[v->name] << " is not a constant"); }
+                        e = my_parser::IntLiteral{(my_lexer::i32)cast<ConstantInt>(cast<GlobalVariable>(symbol.alloca)->getInitializer())->getSExtValue()};
+                    }
+                } substitute{symbols, ids};
+                substitute.walk(e);
+
+                my_passes::ConstInit{consts}.walk(e);
+                auto *lit = std::get_if<my_parser::IntLiteral>(&e);
+                if (!lit) { ABORT("Expected a constant expression"); }
+                return lit->body;
+            }
+
+
+            void run_passes(my_parser::Func& f) { if (opts.ast_passes) { my_memstats::Scope phase{my_memstats::PASSES}; passes.run(f); } }
+
+
+
+            // Runs once a function (and the par bodies outlined from it) is complete.
+            void finish_function(Function *f)
+            {
+                std::vector<Function *> parts{f};
+                parts.insert(parts.end(), par_bodies.begin(), par_bodies.end());
+                par_bodies.clear();
+
+                if (report) { for (Function *g : parts) { report->functions[g->getName().str()].generated = IRStats::of(*g); } }
+                if (opts.frame_report) { for (Function *g : parts) { measure_frame(*g); } }
+
+                bool whole_module = report && opts.split.empty(); // optimized all at once by finish_report().
+                if (optimizer && !whole_module) { my_memstats::Scope phase{my_memstats::OPTIMIZE}; for (Function *g : parts) { optimizer->run(*g); } }
+
+                if (opts.split.empty()) { return; }
+                my_memstats::Scope phase{my_memstats::EMIT};
+
+                // Copy the function and its par bodies into a module of their own, emit that and keep only a
+                // declaration here.
+                std::unique_ptr<Module> part = split_module(parts);
+
+                std::string path = opts.split + "." + std::to_string(++split_count) + ".o";
+                std::error_code error_opening_file;
+                raw_fd_ostream file(path, error_opening_file);
+                if (error_opening_file) { ABORT("error writing to " << path << ": " << error_opening_file); }
+
+                if (verifyModule(*part, &errs())) { ABORT("Module verification failed for " << f->getName().str()); }
+                legacy::PassManager pm;
+                if (split_tm->addPassesToEmitFile(pm, file, nullptr, CodeGenFileType::ObjectFile)) { ABORT("Target can't emit object files"); }
+                pm.run(*part);
+
+                // The par bodies were only called from f (or each other), so they go away with its body.
+                for (Function *g : parts) { g->deleteBody(); }
+                for (Function *g : parts) { if (g != f) { g->eraseFromParent(); } }
+            }
+
+
+
+            // A module with the parts, the internal helpers and constants they use (write, format strings, ...) and
+            // declarations of everything else they reference. Only what the parts use is looked at, so splitting a
+            // function costs its own size, not the module's.
+            std::unique_ptr<Module> split_module(const std::vector<Function *>& parts)
+            {
+                auto part = std::make_unique<Module>(parts[0]->getName(), ctx);
+                part->setTargetTriple(mod.getTargetTriple());
+                part->setDataLayout(mod.getDataLayout());
+
+                ValueToValueMapTy map;
+                std::vector<GlobalValue *> defined;     // copied with their bodies/initializers, in order.
+                std::unordered_set<const Constant *> seen;
+
+                auto declare = [&](GlobalValue *gv) {
+                    if (map.count(gv)) { return; }
+                    bool define = gv->hasLocalLinkage() || std::find(parts.begin(), parts.end(), gv) != parts.end();
+                    GlobalValue *copy;
+                    if (auto *fn = dyn_cast<Function>(gv))
+                    {
+                        Function *decl = Function::Create(fn->getFunctionType(), define ? fn->getLinkage() : GlobalValue::ExternalLinkage, fn->getName(), *part);
+                        decl->copyAttributesFrom(fn);
+                        copy = decl;
+                    }
+                    else
+                    {
+                        auto *var = cast<GlobalVariable>(gv);
+                        copy = new GlobalVariable(*part, var->getValueType(), var->isConstant(), define ? var->getLinkage() : GlobalValue::ExternalLinkage,
+                                                  nullptr, var->getName(), nullptr, var->getThreadLocalMode(), var->getAddressSpace());
+                        cast<GlobalVariable>(copy)->setAlignment(var->getAlign());
+                        copy->setUnnamedAddr(var->getUnnamedAddr());
+                    }
+                    map[gv] = copy;
+                    if (define) { defined.push_back(gv); }
+                };
+                std::function<void(Value *)> uses = [&](Value *v) {
+                    if (auto *gv = dyn_cast<GlobalValue>(v)) { declare(gv); return; }
+                    auto *c = dyn_cast<Constant>(v);
+                    if (!c || !seen.insert(c).second) { return; }
+                    for (Value *op : c->operands()) { uses(op); } // constant expressions and aggregates.
+                };
 
+                for (Function *f : parts) { declare(f); }
+                for (size_t i = 0; i < defined.size(); ++i) // grows as the definitions use more internal helpers.
+                {
+                    if (auto *var = dyn_cast<GlobalVariable>(defined[i])) { if (var->hasInitializer()) { uses(var->getInitializer()); } continue; }
+                    for (Instruction& inst : instructions(*cast<Function>(defined[i]))) { for (Value *op : inst.operands()) { uses(op); } }
+                }
+
+                for (GlobalValue *gv : defined)
+                {
+                    if (auto *var = dyn_cast<GlobalVariable>(gv))
+                    {
+                        if (var->hasInitializer()) { cast<GlobalVariable>(map[var])->setInitializer(MapValue(var->getInitializer(), map)); }
+                        continue;
+                    }
+                    auto *fn = cast<Function>(gv);
+                    auto *copy = cast<Function>(map[fn]);
+                    for (Argument& arg : fn->args()) { map[&arg] = copy->getArg(arg.getArgNo()); }
+                    SmallVector<ReturnInst *, 8> returns;
+                    CloneFunctionInto(copy, fn, map, CloneFunctionChangeType::DifferentModule, returns); // debug info too.
+                }
+
+                if (NamedMDNode *flags = mod.getModuleFlagsMetadata())
+                {
+                    NamedMDNode *copy = part->getOrInsertModuleFlagsMetadata();
+                    for (MDNode *flag : flags->operands()) { copy->addOperand(MapMetadata(flag, map)); }
+                }
+                return part;
+            }
+
+            // Runs the module pipeline if functions weren't optimized one by one, takes the final sizes and prints it all.
+            void finish_report()
+            {
+                if (optimizer && opts.split.empty()) { my_memstats::Scope phase{my_memstats::OPTIMIZE}; optimizer->run(mod); }
+                for (Function& f : mod)
+                {
+                    auto found = report->functions.find(f.getName().str());
+                    if (found == report->functions.end() || f.isDeclaration()) { continue; }
+                    found->second.optimized = IRStats::of(f);
+                    found->second.has_optimized = true;
+                }
+                report->detach(ctx);
+                report->print(errs());
+            }
 
+
+
+            // struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; }; // params variable or array (value).
+            // struct Variable { my_lexer::i32 name; }; 
+            // Parameter types and names of f. Variables are i32, arrays are pointers.
+            FunctionType* gen_signature(my_parser::Func& f, std::vector<my_lexer::i32>& parameter_names)
+            {
                 std::vector<Type *> parameters_types; // need to pass data type of params to function.
-                std::vector<my_lexer::i32> parameter_names; // get name of params.
 
                 // Need to determine data type of params and names
                 for (auto& param_expr : f.params)
@@ -142,9 +501,10 @@ namespace llvm
                             parameters_types.push_back(builder.getInt32Ty());
                             parameter_names.push_back(v.name);
                         },
-                        // its an array so type is a pointer: eg, fn(a[4])
+                        // its an array so it's passed as a slice, a pointer and its length: eg, fn(a[4])
                         [&](my_parser::Array& arr) {
                             parameters_types.push_back(builder.getPtrTy()); // llvm handles ptrs for us.
+                            parameters_types.push_back(builder.getInt32Ty());
                             parameter_names.push_back(arr.name);
                         },
                         // default (other)
@@ -152,47 +512,346 @@ namespace llvm
                     );
                 }
 
-                 
-
-
                 // We need to know the function's type. For this lang, its always a i32.
                 FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), parameters_types, false);
                                                 //   (return type, param type, isVarArg)
 
+                return sig;
+            }
+
+
+            // Prototype only, so calls to f can be generated before its body is.
+            void declare_function(my_parser::Func& f)
+            {
+                std::string name = std::string(ids[f.name]);
+                if (is_builtin(name)) { ABORT("Function " << name << " takes the name of a builtin"); } // calls would never reach it.
+                if (functions[name]) { return; }
+
+                std::vector<my_lexer::i32> parameter_names;
+                functions[name] = Function::Create(gen_signature(f, parameter_names), GlobalValue::ExternalLinkage, name, mod);
+            }
+
+
+            // Names of the functions called from the block that are not declared yet, each once.
+            std::vector<my_lexer::i32> undeclared_callees(my_parser::Block& block)
+            {
+                struct Check : my_passes::Visitor<Check>
+                {
+                    std::unordered_map<std::string, Function *>& functions;
+                    my_lexer::Interner& ids;
+                    std::vector<my_lexer::i32> missing;
+                    Check(std::unordered_map<std::string, Function *>& functions, my_lexer::Interner& ids) : functions(functions), ids(ids) {}
+
+                    void leave_expr(my_parser::Expr& e)
+                    {
+                        auto *call = std::get_if<my_parser::FnCall>(&e);
+                        if (!call) { return; }
+                        std::string_view name = ids[call->name];
+                        auto fn = functions.find(std::string(name));
+                        if (is_builtin(name) || (fn != functions.end() && fn->second)) { return; }
+                        if (std::find(missing.begin(), missing.end(), call->name) == missing.end()) { missing.push_back(call->name); }
+                    }
+                } check{functions, ids};
+
+                check.walk(block);
+                return std::move(check.missing);
+            }
+
+
+            // Pipelined: a parser thread hands finished functions to codegen (this thread) through a lock-free queue,
+            // so parsing the next function overlaps with generating the current one.
+            // Functions whose callees were not declared yet wait in 'deferred', indexed by the names they wait on,
+            // and are defined (and freed) as soon as the last of those names is declared.
+            void gen_pipelined(my_lexer::u8 *text)
+            {
+                my_tools::SpscQueue<std::optional<my_parser::TopLevel>, 64> queue;
+                std::jthread parser([&] {
+                    my_parser::Parser{text, ids}([&](my_parser::TopLevel&& item) {
+                        if (auto *f = std::get_if<my_parser::Func>(&item)) { run_passes(*f); } // passes run on this thread too.
+                        queue.push(std::move(item));
+                    });
+                    queue.push(std::nullopt); // end of program.
+                });
+
+                struct Waiting { std::optional<my_parser::Func> f; size_t missing; }; // f is reset once defined.
+                std::vector<Waiting> deferred;
+                std::unordered_map<my_lexer::i32, std::vector<size_t>> waiting_on; // callee name -> indices into deferred.
+                auto define = [&](my_parser::Func& f) { finish_function(gen_function(f)); };
+
+                while (std::optional<my_parser::TopLevel> item = queue.pop())
+                {
+                    if (auto *g = std::get_if<my_parser::Global>(&*item)) { gen_global(*g); continue; }
+                    my_parser::Func *f = &std::get<my_parser::Func>(*item);
+                    my_lexer::i32 name = f->name;
+
+                    declare_const(*f);
+                    declare_function(*f);
+                    std::vector<my_lexer::i32> missing = undeclared_callees(f->body);
+                    if (missing.empty()) { define(*f); }
+                    else
+                    {
+                        for (my_lexer::i32 callee : missing) { waiting_on[callee].push_back(deferred.size()); }
+                        deferred.push_back({std::move(*f), missing.size()});
+                    }
+
+                    // f's prototype may be the last one some deferred functions were waiting for.
+                    auto waiters = waiting_on.find(name);
+                    if (waiters == waiting_on.end()) { continue; }
+                    for (size_t i : waiters->second)
+                    {
+                        if (--deferred[i].missing) { continue; }
+                        define(*deferred[i].f);
+                        deferred[i].f.reset();
+                    }
+                    waiting_on.erase(waiters);
+                }
+
+                // Whatever is left calls something never declared: gen_expr reports it.
+                for (auto& w : deferred) { if (w.f) { define(*w.f); } }
+            }
+
+
+            Function* gen_function(my_parser::Func& f)
+            {
+                //{ 
+                //    FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), {}, false);
+                //    functions["main"] = Function::Create(sig, GlobalValue::ExternalLinkage, "main", mod);
+                //    BasicBlock *block = BasicBlock::Create(ctx, "entry", functions["main"]);
+                //    builder.SetInsertPoint(block);
+                //}
+
+
+                // std::unordered_map<std::string, Function *> functions; (tracking functions with strings).
+
+                // struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; };
+                // get the name of function 
+                std::string name = std::string(ids[f.name]);
+                if (is_builtin(name)) { ABORT("Function " << name << " takes the name of a builtin"); } // calls would never reach it.
+
+
+                std::vector<my_lexer::i32> parameter_names; // get name of params.
+                FunctionType* sig = gen_signature(f, parameter_names);
+
                 // We now have param types, and function's type so we can create funciton
                 // We map it to name in functions map.
-                functions[name] = Function::Create(sig, GlobalValue::ExternalLinkage, name, mod);
+                // (unless it was already declared ahead of its body by declare_function()).
+                if (!functions[name] || !functions[name]->empty()) { functions[name] = Function::Create(sig, GlobalValue::ExternalLinkage, name, mod); }
 
                 // Create a basic block for funciton:
                 // Create an entry for function
                 BasicBlock *entry_block = BasicBlock::Create(ctx, "entry", functions[name]);
 
                 builder.SetInsertPoint(entry_block); // move builder entry func bb.
+                DISubprogram *outer_scope = begin_subprogram(functions[name], f.line);
 
                 // create/push scope for function into stack of scopes.
                 ++symbols;
                 {
                     // inject params in function's scope
 
-                    size_t i = 0;
-                    for (Argument& arg : functions[name]->args())
+                    Function *fn = functions[name];
+                    for (size_t i = 0, a = 0; i < parameter_names.size(); ++i, ++a)
                     {
-                        if (arg.getType() == builder.getInt32Ty())
+                        Argument *arg = fn->getArg(a);
+                        if (arg->getType() == builder.getInt32Ty())
                         {
-                            AllocaInst *alloca = builder.CreateAlloca(builder.getInt32Ty(), nullptr, "");
-                            builder.CreateStore(&arg, alloca);
+                            AllocaInst *alloca = entry_alloca(builder.getInt32Ty());
+                            builder.CreateStore(arg, alloca);
                             symbols.push(parameter_names[i], alloca, false);
                         }
                         else
                         {
-                            symbols.push(parameter_names[i], &arg, true);
+                            symbols.push(parameter_names[i], arg, true, fn->getArg(++a)); // the slice's length follows its pointer.
                         }
-                        ++i;
                     }
 
                 }
+                if (opts.profile) { prof_begin(name); }
+                arena_mark = uses_arena(f.body) ? builder.CreateCall(functions["__arena_mark"]) : nullptr;
                 for (auto& s : f.body.body) { gen_stmt(s); }
                 --symbols;
+                if (opts.profile) { prof_end(); }
+                end_subprogram(outer_scope);
+                return functions[name];
+            }
+
+
+
+            // Does the block declare an array whose size is only known at run time, or one too big for the stack?
+            // Those live in the thread's arena (runtime.cpp) and get freed all at once when the function returns.
+            // Par bodies are their own functions, so they are not looked into.
+            bool uses_arena(my_parser::Block& block)
+            {
+                struct Find : my_passes::Visitor<Find>
+                {
+                    Compiler& c;
+                    bool found = false;
+                    Find(Compiler& c) : c(c) {}
+                    bool enter_stmt(my_parser::Stmt& s)
+                    {
+                        if (auto *let = std::get_if<my_parser::Let>(&s))
+                        {
+                            auto *arr = std::get_if<my_parser::Array>(&let->body);
+                            auto *size = arr ? std::get_if<my_parser::IntLiteral>(&arr->size[0]) : nullptr;
+                            found |= arr && (!size || c.too_big_for_stack(size->body));
+                        }
+                        return !found && !std::holds_alternative<my_parser::Par>(s);
+                    }
+                } find{*this};
+
+                find.walk(block);
+                return find.found;
+            }
+
+
+            // Debug info scope of a function (or par body) that starts at line; returns the enclosing one.
+            DISubprogram *begin_subprogram(Function *f, unsigned line)
+            {
+                DISubprogram *saved = di_scope;
+                if (!dib) { return saved; }
+                DISubroutineType *type = dib->createSubroutineType(dib->getOrCreateTypeArray({}));
+                di_scope = dib->createFunction(di_file, f->getName(), f->getName(), di_file, line, type, line,
+                                               DINode::FlagPrototyped, DISubprogram::SPFlagDefinition);
+                f->setSubprogram(di_scope);
+                builder.SetCurrentDebugLocation(DILocation::get(ctx, line, 0, di_scope)); // the prologue.
+                return saved;
+            }
+
+            void end_subprogram(DISubprogram *saved, DebugLoc saved_loc = {})
+            {
+                if (!dib) { return; }
+                dib->finalizeSubprogram(di_scope);
+                di_scope = saved;
+                builder.SetCurrentDebugLocation(saved_loc);
+            }
+
+            // 'loop unroll(n) vectorize(n) interleave(n)': llvm.loop metadata on every back-edge (the end of the body and
+            // each continue). A count of 1 turns the transformation off. The report lists whether each was done.
+            void hint_loop(BasicBlock *header, BasicBlock *preheader, const my_parser::LoopHints& hints, unsigned line)
+            {
+                auto property = [&](const char *name, Metadata *value = nullptr) -> Metadata * {
+                    std::vector<Metadata *> ops{MDString::get(ctx, name)};
+                    if (value) { ops.push_back(value); }
+                    return MDNode::get(ctx, ops);
+                };
+                auto count = [&](my_lexer::i32 n) { return ConstantAsMetadata::get(builder.getInt32(n)); };
+
+                std::vector<Metadata *> ops{nullptr}; // a loop id refers to itself.
+                if (di_scope) { ops.push_back(DILocation::get(ctx, line, 0, di_scope)); } // so remarks point at the 'loop' line.
+                std::string text;
+                if (hints.unroll == 1)   { ops.push_back(property("llvm.loop.unroll.disable")); }
+                else if (hints.unroll)   { ops.push_back(property("llvm.loop.unroll.count", count(hints.unroll))); }
+                if (hints.vectorize)
+                {
+                    ops.push_back(property("llvm.loop.vectorize.width", count(hints.vectorize)));
+                    ops.push_back(property("llvm.loop.vectorize.enable", ConstantAsMetadata::get(builder.getInt1(hints.vectorize > 1))));
+                }
+                if (hints.interleave)    { ops.push_back(property("llvm.loop.interleave.count", count(hints.interleave))); }
+                if (hints.unroll)        { text += " unroll(" + std::to_string(hints.unroll) + ")"; }
+                if (hints.vectorize)     { text += " vectorize(" + std::to_string(hints.vectorize) + ")"; }
+                if (hints.interleave)    { text += " interleave(" + std::to_string(hints.interleave) + ")"; }
+
+                MDNode *loop_id = MDNode::getDistinct(ctx, ops);
+                loop_id->replaceOperandWith(0, loop_id);
+                for (BasicBlock *pred : predecessors(header))
+                {
+                    if (pred != preheader) { pred->getTerminator()->setMetadata(LLVMContext::MD_loop, loop_id); }
+                }
+
+                if (report) { report->hint(header->getParent()->getName().str(), line, text.substr(1), hints.unroll > 1, hints.vectorize > 1 || hints.interleave > 1); }
+            }
+
+            bool too_big_for_stack(my_lexer::i32 length) const { return (uint64_t)length * sizeof(my_lexer::i32) > opts.stack_limit; }
+
+            // Fixed size allocas all go to the top of the entry block, wherever their 'let' is: then they are part of
+            // the static frame, instead of growing the stack again on every trip through a loop.
+            AllocaInst *entry_alloca(Type *type, Value *count = nullptr)
+            {
+                BasicBlock& entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+                IRBuilder<NoFolder> top(&entry, entry.begin());
+                return top.CreateAlloca(type, count);
+            }
+
+            // Static frame as generated (-O later turns most scalar slots into registers, arrays stay).
+            void measure_frame(Function& f)
+            {
+                Frame& frame = frames[f.getName().str()];
+                for (Instruction& inst : f.getEntryBlock())
+                {
+                    auto *alloca = dyn_cast<AllocaInst>(&inst);
+                    if (!alloca || !alloca->isStaticAlloca()) { continue; }
+                    if (auto bits = alloca->getAllocationSizeInBits(mod.getDataLayout())) { frame.bytes += (uint64_t)*bits / 8; }
+                    frame.arrays += alloca->isArrayAllocation();
+                }
+            }
+
+            void print_frames(raw_ostream& os)
+            {
+                std::vector<std::pair<std::string, Frame>> sorted(frames.begin(), frames.end());
+                std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.second.bytes > b.second.bytes; });
+                if (sorted.size() > 20) { sorted.resize(20); }
+
+                os << "function                 frame bytes   arrays  in arena (limit " << opts.stack_limit << ")\n";
+                for (auto& [name, frame] : sorted) { os << format("%-24s %11llu %8llu %9llu\n", name.c_str(), (unsigned long long)frame.bytes, (unsigned long long)frame.arrays, (unsigned long long)frame.promoted); }
+            }
+
+
+            // Every return goes through here so the function's arena allocations are released (and its profile frame closed) first.
+            void gen_ret(Value *value)
+            {
+                if (arena_mark) { builder.CreateCall(functions["__arena_release"], {arena_mark}); }
+                if (prof_record) { builder.CreateCall(functions["__prof_exit"], {prof_record}); }
+                builder.CreateRet(value);
+            }
+
+
+
+            // Profiling: the function's record (external, so split objects share the one in the main module) and entry hook.
+            // The trip counters are a placeholder until the number of loops is known.
+            void prof_begin(const std::string& name)
+            {
+                prof_record = new GlobalVariable(mod, prof_type, false, GlobalValue::ExternalLinkage, nullptr, "__prof." + name);
+                prof_trips  = new GlobalVariable(mod, builder.getInt64Ty(), false, GlobalValue::InternalLinkage, builder.getInt64(0), "");
+                prof_loops  = 0;
+                prof_records.push_back(prof_record);
+                builder.CreateCall(functions["__prof_enter"], {prof_record});
+            }
+
+            void prof_end()
+            {
+                std::string name = prof_record->getName().str().substr(7); // drop "__prof.".
+                Constant *trips = ConstantPointerNull::get(builder.getPtrTy());
+                if (prof_loops)
+                {
+                    ArrayType *type = ArrayType::get(builder.getInt64Ty(), prof_loops);
+                    trips = new GlobalVariable(mod, type, false, GlobalValue::ExternalLinkage, ConstantAggregateZero::get(type), "__prof." + name + ".trips");
+                }
+                prof_trips->replaceAllUsesWith(trips);
+                prof_trips->eraseFromParent();
+
+                prof_record->setInitializer(ConstantStruct::get(prof_type, {
+                    builder.CreateGlobalString(name, "", 0, &mod), builder.getInt64(0), builder.getInt64(0), builder.getInt64(0),
+                    builder.getInt32(prof_loops), trips
+                }));
+                prof_record = nullptr;
+                prof_trips  = nullptr;
+            }
+
+            // Bumps the current function's counter for one more loop (plain add: counts from par chunks may drop a few).
+            void prof_trip()
+            {
+                Value *counter = builder.CreateConstGEP1_32(builder.getInt64Ty(), prof_trips, prof_loops++);
+                builder.CreateStore(builder.CreateAdd(builder.CreateLoad(builder.getInt64Ty(), counter), builder.getInt64(1)), counter);
+            }
+
+            // __prof_init(): registers every record with the runtime before main runs.
+            void finish_profile()
+            {
+                Function *init = Function::Create(FunctionType::get(builder.getVoidTy(), false), GlobalValue::InternalLinkage, "__prof_init", mod);
+                builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", init));
+                for (GlobalVariable *record : prof_records) { builder.CreateCall(functions["__prof_register"], {record}); }
+                builder.CreateRetVoid();
+                appendToGlobalCtors(mod, init, 0);
             }
 
 
@@ -202,6 +861,7 @@ namespace llvm
             void gen_stmt(my_parser::Stmt& s) 
             {
                 if(builder.GetInsertBlock()->getTerminator()) { return; }
+                if(di_scope && s.line) { builder.SetCurrentDebugLocation(DILocation::get(ctx, s.line, 0, di_scope)); } // everything it generates is on its line.
 
                 auto gen_block = [&](my_parser::Block& block){
                     ++symbols; // push the block's scope on to stack of scopes (an empty hash table).
@@ -210,20 +870,37 @@ namespace llvm
                 };
                 s(
                     gen_block,
-                    [&](my_parser::Return& ret) { builder.CreateRet(gen_expr(ret.value)); }, // create return IR using ret's value.
+                    [&](my_parser::Return& ret) { // create return IR using ret's value.
+                        if(par_depth) { ABORT("Return inside a par body"); } // the body is its own function, a return would only end one chunk.
+                        gen_ret(gen_expr(ret.value));
+                    },
                     [&](my_parser::Let& let) { // Generate IR for 'let' stmts.
                         let.body(
                             [&](my_parser::Variable& v) {
-                                AllocaInst *alloca = builder.CreateAlloca(builder.getInt32Ty(), nullptr, ""); // allocate mem for a single 32-bit.
+                                AllocaInst *alloca = entry_alloca(builder.getInt32Ty()); // allocate mem for a single 32-bit.
                                 symbols.push(v.name, alloca, false); // push variable to current scope hash table to track.
                             },
                             [&](my_parser::Array& arr) {
                                 arr.size[0]( // an expr
                                     [&](my_parser::IntLiteral& lit) {
-                                        AllocaInst *alloca = builder.CreateAlloca(builder.getInt32Ty(), builder.getInt32(lit.body), ""); // allocate mem for IntLiteral many 32-bits.
-                                        symbols.push(arr.name, alloca, true); // push variable to current scope hash table.
+                                        if (too_big_for_stack(lit.body)) // arena, allocated once right after the function's mark (also if the let is in a loop).
+                                        {
+                                            Instruction *mark = cast<Instruction>(arena_mark);
+                                            IRBuilder<NoFolder> top(mark->getParent(), std::next(mark->getIterator()));
+                                            Value *array = top.CreateCall(functions["__arena_alloc"], {top.getInt64((int64_t)lit.body * sizeof(my_lexer::i32))});
+                                            frames[builder.GetInsertBlock()->getParent()->getName().str()].promoted += (uint64_t)lit.body * sizeof(my_lexer::i32);
+                                            symbols.push(arr.name, array, true, builder.getInt32(lit.body));
+                                            return;
+                                        }
+                                        AllocaInst *alloca = entry_alloca(builder.getInt32Ty(), builder.getInt32(lit.body)); // allocate mem for IntLiteral many 32-bits.
+                                        symbols.push(arr.name, alloca, true, builder.getInt32(lit.body)); // push variable to current scope hash table.
                                     },
-                                    [&](auto&) { ABORT("Tried to declare array with non IntLiteral size"); } // enforce constant int size for array declaration.
+                                    [&](auto&) { // size only known at run time: bump allocate it from the arena instead of the stack.
+                                        Value *length = gen_expr(arr.size[0]);
+                                        Value *size   = builder.CreateSExt(length, builder.getInt64Ty());
+                                        Value *bytes  = builder.CreateMul(size, builder.getInt64(sizeof(my_lexer::i32)));
+                                        symbols.push(arr.name, builder.CreateCall(functions["__arena_alloc"], {bytes}), true, length);
+                                    }
                                 );
                             },
                             [&](auto&){ ABORT ("Let tried to declare non var or array"); }
@@ -235,12 +912,14 @@ namespace llvm
                                 Value *rhs = gen_expr(ass.rhs); // get rhs expr
                                 auto symbol = symbols[v.name]; //  check if variable exists/declared (if not SymbolTable op[] handles with ABORT).
                                 if(symbol.is_array) { ABORT("Tried to assign to a variable as array"); } // "variable"(identifier) is actually an array so can't assign.
+                                if(symbol.is_const) { ABORT("Tried to assign to const " << ids[v.name]); }
                                 builder.CreateStore(rhs, symbol.alloca); // store rhs into lhs mem location.
                             },
                             [&](my_parser::Array& arr) {  // lhs expr is an array.
                                 Value *rhs = gen_expr(ass.rhs); // get rhs expr.
                                 auto symbol = symbols[arr.name]; // check is exists/declared.
                                 if(!symbol.is_array) { ABORT("Tried to assign to array as variable"); } // identifier was used like an array but not array so can't assign.
+                                if(symbol.is_const) { ABORT("Tried to assign to const " << ids[arr.name]); }
                                 Value *index = gen_expr(arr.size[0]); // generate array's index which is an expr.
                                 Value *gep = builder.CreateGEP(builder.getInt32Ty(), symbol.alloca, index); // calculate mem location of array index (offset).
                                 builder.CreateStore(rhs, gep); // store rhs into array location.
@@ -269,9 +948,11 @@ namespace llvm
                         builder.CreateBr(loop_block);         // start loop.
 
                         builder.SetInsertPoint(loop_block);   // point/move builder to loop block to inster IR for its body.
+                        if(opts.profile_loops) { prof_trip(); } // one more trip.
                         gen_block(stmt.body);                 // make IR for loop block instructions.
 
                         if(!builder.GetInsertBlock()->getTerminator()) { builder.CreateBr(loop_block); } // keep branching to top of loop if no terminator (break/continue).
+                        if(stmt.hints.unroll || stmt.hints.vectorize || stmt.hints.interleave) { hint_loop(loop_block, current_block, stmt.hints, s.line); }
                         
                         // loop done.
                         builder.SetInsertPoint(merge_block);  // point/move builder to block after loop. 
@@ -285,8 +966,7 @@ namespace llvm
                         BasicBlock *else_block = BasicBlock::Create(ctx, "", current_block->getParent()); // create new bb for else-block
                         BasicBlock *merge_block = BasicBlock::Create(ctx, "", current_block->getParent()); // create new bb for block after if-else.
 
-                        Value *cond = i32toi1(gen_expr(stmt.cond[0]));  // convert 32-bit to 1-bit for cond-br.
-                        builder.CreateCondBr(cond, if_block, else_block); // cond-branch to if-block or else-block based on cond.
+                        gen_cond(stmt.cond[0], if_block, else_block); // branch straight to if-block or else-block on cond.
 
                         builder.SetInsertPoint(if_block); // point/move builder to if-block bb.
                         gen_block(stmt.body);             // make IR for if-block (goes in if-block bb).
@@ -299,6 +979,32 @@ namespace llvm
 
                         builder.SetInsertPoint(merge_block); // move/point builder to bb after if-else stmt.
                     },
+                    [&](my_parser::Par& stmt){ gen_par(stmt); },
+                    [&](my_parser::Match& stmt){
+                        // One switch: the backend picks a jump table, bit tests or a binary search over the labels.
+                        Function *fn = builder.GetInsertBlock()->getParent();
+                        BasicBlock *merge_block     = BasicBlock::Create(ctx, "", fn);
+                        BasicBlock *otherwise_block = stmt.otherwise ? BasicBlock::Create(ctx, "", fn) : merge_block;
+
+                        size_t cases = 0;
+                        for (auto& arm : stmt.arms) { cases += arm.labels.size(); }
+                        SwitchInst *sw = builder.CreateSwitch(gen_expr(stmt.value), otherwise_block, cases);
+
+                        auto gen_arm = [&](BasicBlock *arm_block, my_parser::Block& body) {
+                            builder.SetInsertPoint(arm_block);
+                            gen_block(body);
+                            if(!builder.GetInsertBlock()->getTerminator()) { builder.CreateBr(merge_block); } // no fall through.
+                        };
+                        for (auto& arm : stmt.arms)
+                        {
+                            BasicBlock *arm_block = BasicBlock::Create(ctx, "", fn);
+                            for (my_lexer::i32 label : arm.labels) { sw->addCase(builder.getInt32(label), arm_block); }
+                            gen_arm(arm_block, arm.body);
+                        }
+                        if(stmt.otherwise) { gen_arm(otherwise_block, *stmt.otherwise); }
+
+                        builder.SetInsertPoint(merge_block);
+                    },
                     [&](my_parser::Nop& stmt){},
                     [&](my_parser::Expr& expr){
                         //builder.CreateCall(functions["printf"], {get_fmt("%d\n"), gen_expr(expr)});
@@ -307,8 +1013,186 @@ namespace llvm
                 );
             }
 
+            // Reduction operators as understood by __par_for in runtime.cpp.
+            static int par_op_code(int op)
+            {
+                switch(op)
+                {
+                    case 0:     { return 0; } break;
+                    case '+':   { return 1; } break;
+                    case '*':   { return 2; } break;
+                    case '&':   { return 3; } break;
+                    case '|':   { return 4; } break;
+                    case '^':   { return 5; } break;
+                    case 'min': { return 6; } break;
+                    case 'max': { return 7; } break;
+                    default:    { ABORT("unhandled reduction? " << my_tools::token_to_string(op)); } break;
+                }
+            }
+
+            // Value every chunk's private accumulator starts from.
+            static my_lexer::i32 par_identity(int op)
+            {
+                switch(op)
+                {
+                    case '*':   { return 1; } break;
+                    case '&':   { return -1; } break;
+                    case 'min': { return INT32_MAX; } break;
+                    case 'max': { return INT32_MIN; } break;
+                    default:    { return 0; } break;
+                }
+            }
+
+            Value* gen_reduce(int op, Value *lhs, Value *rhs)
+            {
+                switch(op)
+                {
+                    case '+':   { return builder.CreateAdd(lhs, rhs); } break;
+                    case '*':   { return builder.CreateMul(lhs, rhs); } break;
+                    case '&':   { return builder.CreateAnd(lhs, rhs); } break;
+                    case '|':   { return builder.CreateOr(lhs, rhs);  } break;
+                    case '^':   { return builder.CreateXor(lhs, rhs); } break;
+                    case 'min': { return builder.CreateSelect(builder.CreateICmpSLT(lhs, rhs), lhs, rhs); } break;
+                    case 'max': { return builder.CreateSelect(builder.CreateICmpSGT(lhs, rhs), lhs, rhs); } break;
+                    default:    { ABORT("unhandled reduction? " << my_tools::token_to_string(op)); } break;
+                }
+            }
+
+            // par i = lo, hi (reduce OP acc)? { body }
+            //
+            // The body is outlined into 'i32 chunk(ptr ctx, i32 lo, i32 hi)' which runs the iterations [lo, hi) and returns
+            // the chunk's partial reduction. Every local visible at the par is captured by address in 'ctx' so the body
+            // reads/writes the enclosing frame directly (the caller blocks inside __par_for until all chunks are done).
+            // The work-stealing runtime (runtime.cpp) splits [lo, hi) into chunks and runs them across cores.
+            void gen_par(my_parser::Par& stmt)
+            {
+                Value *lo = gen_expr(stmt.lo);
+                Value *hi = gen_expr(stmt.hi);
+
+                if(stmt.op && symbols[stmt.acc].is_array) { ABORT("Tried to reduce into an array"); }
+
+                // Capture the enclosing locals: ctx is an array of pointers to them,
+                // followed by pointers to the lengths of arrays whose length is only known at run time.
+                auto captures = symbols.locals();
+                std::vector<size_t> length_slots(captures.size(), 0);
+                size_t slots = captures.size();
+                for (size_t i = 0; i < captures.size(); ++i)
+                {
+                    if (captures[i].second.is_array && !isa<Constant>(captures[i].second.length)) { length_slots[i] = slots++; }
+                }
+                ArrayType *ctx_type = ArrayType::get(builder.getPtrTy(), slots);
+                Value *ctx_ptr = entry_alloca(ctx_type);
+                for (size_t i = 0; i < captures.size(); ++i)
+                {
+                    builder.CreateStore(captures[i].second.alloca, builder.CreateConstGEP2_32(ctx_type, ctx_ptr, 0, i));
+                    if (!length_slots[i]) { continue; }
+                    AllocaInst *length = entry_alloca(builder.getInt32Ty());
+                    builder.CreateStore(captures[i].second.length, length);
+                    builder.CreateStore(length, builder.CreateConstGEP2_32(ctx_type, ctx_ptr, 0, length_slots[i]));
+                }
+
+                // Create the outlined chunk function.
+                BasicBlock *caller_block = builder.GetInsertBlock();
+                std::string name = caller_block->getParent()->getName().str() + ".par" + std::to_string(par_count++);
+                FunctionType *sig = FunctionType::get(builder.getInt32Ty(), {builder.getPtrTy(), builder.getInt32Ty(), builder.getInt32Ty()}, false);
+                Function *chunk = Function::Create(sig, GlobalValue::InternalLinkage, name, mod);
+                par_bodies.push_back(chunk);
+
+                // The body can't break out of or continue the enclosing function's loops.
+                std::vector<BasicBlock*> saved_continue, saved_break;
+                std::swap(saved_continue, continue_stack);
+                std::swap(saved_break, break_stack);
+                ++par_depth;
+                Value *saved_arena_mark = arena_mark;
+                GlobalVariable *saved_prof_record = prof_record; // the chunk's returns don't leave the function.
+                prof_record = nullptr;
+
+                BasicBlock *entry_block = BasicBlock::Create(ctx, "entry", chunk);
+                builder.SetInsertPoint(entry_block);
+                DebugLoc par_loc = builder.getCurrentDebugLocation();
+                DISubprogram *outer_scope = begin_subprogram(chunk, par_loc ? par_loc.getLine() : 0);
+
+                ++symbols; // scope holding the captures, the index and the private accumulator.
+                for (size_t i = 0; i < captures.size(); ++i)
+                {
+                    Value *slot = builder.CreateConstGEP2_32(ctx_type, chunk->getArg(0), 0, i);
+                    Value *length = captures[i].second.length; // constant, or reloaded from its slot.
+                    if (length_slots[i])
+                    {
+                        Value *length_slot = builder.CreateConstGEP2_32(ctx_type, chunk->getArg(0), 0, length_slots[i]);
+                        length = builder.CreateLoad(builder.getInt32Ty(), builder.CreateLoad(builder.getPtrTy(), length_slot));
+                    }
+                    symbols.push(captures[i].first, builder.CreateLoad(builder.getPtrTy(), slot), captures[i].second.is_array, length);
+                }
+
+                arena_mark = uses_arena(stmt.body) ? builder.CreateCall(functions["__arena_mark"]) : nullptr; // chunks run on other threads, with their own arenas.
+
+                AllocaInst *index = entry_alloca(builder.getInt32Ty());
+                builder.CreateStore(chunk->getArg(1), index);
+                symbols.push(stmt.index, index, false);
+
+                AllocaInst *acc = nullptr;
+                if(stmt.op)
+                {
+                    acc = entry_alloca(builder.getInt32Ty());
+                    builder.CreateStore(builder.getInt32(par_identity(stmt.op)), acc);
+                    symbols.push(stmt.acc, acc, false); // shadows the captured acc inside the body.
+                }
+
+                BasicBlock *cond_block  = BasicBlock::Create(ctx, "", chunk);
+                BasicBlock *body_block  = BasicBlock::Create(ctx, "", chunk);
+                BasicBlock *latch_block = BasicBlock::Create(ctx, "", chunk);
+                BasicBlock *exit_block  = BasicBlock::Create(ctx, "", chunk);
+
+                builder.CreateBr(cond_block);
+                builder.SetInsertPoint(cond_block);
+                Value *i = builder.CreateLoad(builder.getInt32Ty(), index);
+                builder.CreateCondBr(builder.CreateICmpSLT(i, chunk->getArg(2)), body_block, exit_block);
+
+                builder.SetInsertPoint(body_block);
+                continue_stack.push_back(latch_block); // continue moves on to the next iteration.
+                ++symbols;
+                for(auto& s : stmt.body.body) { gen_stmt(s); }
+                --symbols;
+                continue_stack.pop_back();
+                if(!builder.GetInsertBlock()->getTerminator()) { builder.CreateBr(latch_block); }
+
+                builder.SetInsertPoint(latch_block);
+                builder.CreateStore(builder.CreateAdd(builder.CreateLoad(builder.getInt32Ty(), index), builder.getInt32(1)), index);
+                builder.CreateBr(cond_block);
+
+                builder.SetInsertPoint(exit_block);
+                gen_ret(acc ? builder.CreateLoad(builder.getInt32Ty(), acc) : (Value *)builder.getInt32(0));
+                --symbols;
+
+                arena_mark = saved_arena_mark;
+                prof_record = saved_prof_record;
+                --par_depth;
+                std::swap(saved_continue, continue_stack);
+                std::swap(saved_break, break_stack);
+                end_subprogram(outer_scope, par_loc);
+                builder.SetInsertPoint(caller_block);
+
+                // Run it and fold the combined chunk results into acc.
+                Value *result = builder.CreateCall(functions["__par_for"], {chunk, ctx_ptr, lo, hi, builder.getInt32(par_op_code(stmt.op))});
+                if(stmt.op)
+                {
+                    Value *outer = symbols[stmt.acc].alloca;
+                    builder.CreateStore(gen_reduce(stmt.op, builder.CreateLoad(builder.getInt32Ty(), outer), result), outer);
+                }
+            }
+
             void setup()
             {
+                if (opts.debug_info)
+                {
+                    mod.addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+                    mod.addModuleFlag(Module::Warning, "Dwarf Version", 4);
+                    dib = std::make_unique<DIBuilder>(mod);
+                    di_file = dib->createFile(sys::path::filename(opts.source), sys::path::parent_path(opts.source));
+                    dib->createCompileUnit(dwarf::DW_LANG_C, di_file, "complier", opts.opt_level > 0, "", 0);
+                }
+
                 //  Setup main() before lang had functions (manually create one)
                 //  users now create the main().
                 //{ 
@@ -327,6 +1211,34 @@ namespace llvm
                     functions["scanf"] = Function::Create(sig, GlobalValue::ExternalLinkage, "scanf", mod);
                 }
 
+                { // memcmp(a, b, bytes), for equal().
+                    FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), {builder.getPtrTy(), builder.getPtrTy(), builder.getInt64Ty()}, false);
+                    functions["memcmp"] = Function::Create(sig, GlobalValue::ExternalLinkage, "memcmp", mod);
+                }
+
+                { // __par_for(chunk, ctx, lo, hi, op) lives in runtime.cpp, linked with the generated program.
+                    FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), {builder.getPtrTy(), builder.getPtrTy(), builder.getInt32Ty(), builder.getInt32Ty(), builder.getInt32Ty()}, false);
+                    functions["__par_for"] = Function::Create(sig, GlobalValue::ExternalLinkage, "__par_for", mod);
+                }
+
+                { // __arena_alloc(bytes), __arena_mark() and __arena_release(mark): per-thread bump allocator in runtime.cpp.
+                    FunctionType* alloc_sig = FunctionType::get(builder.getPtrTy(), {builder.getInt64Ty()}, false);
+                    functions["__arena_alloc"] = Function::Create(alloc_sig, GlobalValue::ExternalLinkage, "__arena_alloc", mod);
+
+                    FunctionType* mark_sig = FunctionType::get(builder.getInt64Ty(), {}, false);
+                    functions["__arena_mark"] = Function::Create(mark_sig, GlobalValue::ExternalLinkage, "__arena_mark", mod);
+
+                    FunctionType* release_sig = FunctionType::get(builder.getVoidTy(), {builder.getInt64Ty()}, false);
+                    functions["__arena_release"] = Function::Create(release_sig, GlobalValue::ExternalLinkage, "__arena_release", mod);
+                }
+
+                if (opts.profile) // __prof_register/__prof_enter/__prof_exit(record) in runtime.cpp.
+                {
+                    prof_type = StructType::create(ctx, {builder.getPtrTy(), builder.getInt64Ty(), builder.getInt64Ty(), builder.getInt64Ty(), builder.getInt32Ty(), builder.getPtrTy()}, "ProfRecord");
+                    FunctionType* sig = FunctionType::get(builder.getVoidTy(), {builder.getPtrTy()}, false);
+                    for (const char *hook : {"__prof_register", "__prof_enter", "__prof_exit"}) { functions[hook] = Function::Create(sig, GlobalValue::ExternalLinkage, hook, mod); }
+                }
+
                 { // write(num)
                     FunctionType* sig = FunctionType::get(Type::getInt32Ty(ctx), builder.getInt32Ty(), false);
                                                     //   (return type i32, param type i32, isVarArg)
@@ -372,6 +1284,125 @@ namespace llvm
                 }
             }
 
+            // Builtins on slices (arrays and array parameters, which know their length):
+            //     len(a)          number of elements.
+            //     fill(a, v)      sets every element to v, returns len(a).
+            //     copy(dst, src)  copies min(len(dst), len(src)) elements, returns how many.
+            //     equal(a, b)     1 if both have the same length and elements, 0 otherwise.
+            // Bulk work goes to llvm.memset/memcpy and memcmp, so it runs on libc's vectorized routines.
+            static bool is_builtin(std::string_view name) { return name == "len" || name == "fill" || name == "copy" || name == "equal"; }
+
+            // The array an argument names.
+            SymbolTable::Symbol slice(my_parser::Expr& e)
+            {
+                auto *v = std::get_if<my_parser::Variable>(&e);
+                if(!v) { ABORT("Expected an array"); }
+                auto symbol = symbols[v->name];
+                if(!symbol.is_array) { ABORT("Expected an array, " << ids[v->name] << " is a variable"); }
+                return symbol;
+            }
+
+            Value* gen_builtin(std::string_view name, my_parser::FnCall& call)
+            {
+                size_t arity = name == "len" ? 1 : 2;
+                if(call.args.size() != arity) { ABORT(name << " takes " << arity << " arguments"); }
+
+                auto a = slice(call.args[0]);
+                if(a.is_const && (name == "fill" || name == "copy")) { ABORT("Tried to " << name << " a const array"); }
+                if(name == "len") { return a.length; }
+
+                if(name == "fill")
+                {
+                    // memset when all four bytes of the value are the same (0, -1, ...), a store loop otherwise.
+                    auto *lit = std::get_if<my_parser::IntLiteral>(&call.args[1]);
+                    uint32_t v = lit ? (uint32_t)lit->body : 0;
+                    if(lit && v == (v & 0xFF) * 0x01010101u)
+                    {
+                        Value *bytes_a = builder.CreateMul(builder.CreateZExt(a.length, builder.getInt64Ty()), builder.getInt64(sizeof(my_lexer::i32)));
+                        builder.CreateMemSet(a.alloca, builder.getInt8(v & 0xFF), bytes_a, MaybeAlign(alignof(my_lexer::i32)));
+                        return a.length;
+                    }
+
+                    Value *value = gen_expr(call.args[1]);
+                    BasicBlock *before = builder.GetInsertBlock();
+                    BasicBlock *body   = BasicBlock::Create(ctx, "", before->getParent());
+                    BasicBlock *done   = BasicBlock::Create(ctx, "", before->getParent());
+                    builder.CreateCondBr(builder.CreateICmpSGT(a.length, builder.getInt32(0)), body, done);
+
+                    builder.SetInsertPoint(body);
+                    PHINode *i = builder.CreatePHI(builder.getInt32Ty(), 2);
+                    i->addIncoming(builder.getInt32(0), before);
+                    builder.CreateStore(value, builder.CreateGEP(builder.getInt32Ty(), a.alloca, i));
+                    Value *next = builder.CreateAdd(i, builder.getInt32(1));
+                    i->addIncoming(next, body);
+                    builder.CreateCondBr(builder.CreateICmpSLT(next, a.length), body, done);
+
+                    builder.SetInsertPoint(done);
+                    return a.length;
+                }
+
+                auto b = slice(call.args[1]);
+                Value *shorter = builder.CreateSelect(builder.CreateICmpULT(a.length, b.length), a.length, b.length);
+                Value *bytes   = builder.CreateMul(builder.CreateZExt(shorter, builder.getInt64Ty()), builder.getInt64(sizeof(my_lexer::i32)));
+
+                if(name == "copy")
+                {
+                    // Arrays declared here (stack or arena) never overlap another one; parameters and captures may be the same array.
+                    auto owned = [](Value *p) { return isa<AllocaInst>(p) || isa<CallInst>(p); };
+                    MaybeAlign align(alignof(my_lexer::i32));
+                    if(owned(a.alloca) && owned(b.alloca) && a.alloca != b.alloca) { builder.CreateMemCpy(a.alloca, align, b.alloca, align, bytes); }
+                    else                                                         { builder.CreateMemMove(a.alloca, align, b.alloca, align, bytes); }
+                    return shorter;
+                }
+
+                // equal
+                Value *same_length = builder.CreateICmpEQ(a.length, b.length);
+                Value *cmp = builder.CreateCall(functions["memcmp"], {a.alloca, b.alloca, bytes});
+                return i1toi32(builder.CreateAnd(same_length, builder.CreateICmpEQ(cmp, builder.getInt32(0))));
+            }
+
+            static CmpInst::Predicate comparison(int op)
+            {
+                switch(op)
+                {
+                    case '>':  { return CmpInst::ICMP_SGT; } break;
+                    case '<':  { return CmpInst::ICMP_SLT; } break;
+                    case '<=': { return CmpInst::ICMP_SLE; } break;
+                    case '>=': { return CmpInst::ICMP_SGE; } break;
+                    case '==': { return CmpInst::ICMP_EQ;  } break;
+                    case '!=': { return CmpInst::ICMP_NE;  } break;
+                    default:   { return CmpInst::BAD_ICMP_PREDICATE; } break;
+                }
+            }
+
+            // Branches to true_block or false_block on e, without materializing its value:
+            // comparisons feed the branch directly, ! swaps the targets and && / || chain branches (no PHI, no zext/icmp).
+            void gen_cond(my_parser::Expr& e, BasicBlock *true_block, BasicBlock *false_block)
+            {
+                if(auto *lit = std::get_if<my_parser::IntLiteral>(&e)) { builder.CreateBr(lit->body ? true_block : false_block); return; }
+
+                auto *op = std::get_if<my_parser::MathOp>(&e);
+                if(op && (op->op == '&&' || op->op == '||'))
+                {
+                    BasicBlock *rhs_block = BasicBlock::Create(ctx, "", builder.GetInsertBlock()->getParent());
+                    if(op->op == '&&') { gen_cond(op->body[0], rhs_block, false_block); } // false already decides &&,
+                    else               { gen_cond(op->body[0], true_block, rhs_block); }  // true decides ||.
+                    builder.SetInsertPoint(rhs_block);
+                    gen_cond(op->body[1], true_block, false_block);
+                    return;
+                }
+                if(op && op->op == '!' && op->body.size() == 1) { gen_cond(op->body[0], false_block, true_block); return; }
+                if(op && op->body.size() == 2 && comparison(op->op) != CmpInst::BAD_ICMP_PREDICATE)
+                {
+                    Value *lhs = gen_expr(op->body[0]);
+                    Value *rhs = gen_expr(op->body[1]);
+                    builder.CreateCondBr(builder.CreateICmp(comparison(op->op), lhs, rhs), true_block, false_block);
+                    return;
+                }
+
+                builder.CreateCondBr(i32toi1(gen_expr(e)), true_block, false_block);
+            }
+
             Value* i1toi32(Value *i1)
             {
                 return builder.CreateZExt(i1, builder.getInt32Ty());
@@ -386,11 +1417,26 @@ namespace llvm
             {
                 return e (
                     [&](my_parser::FnCall& call) -> Value * {
-                        Function *fn = functions[std::string(my_lexer::ids[call.name])]; // get function from functions map.
+                        std::string_view name = ids[call.name];
+                        if(is_builtin(name)) { return gen_builtin(name, call); } // len/fill/copy/equal.
+
+                        Function *fn = functions[std::string(name)]; // get function from functions map.
                         if(!fn) { ABORT ("Tried to call undeclared function"); } // func with that name does not exists.
 
                         std::vector<Value *> args;
-                        for (auto& arg : call.args) { args.push_back(gen_expr(arg)); } // get args for IR.
+                        for (auto& arg : call.args) // get args for IR.
+                        {
+                            if(args.size() < fn->arg_size() && fn->getArg(args.size())->getType()->isPointerTy()) // array parameter: pass the slice.
+                            {
+                                auto symbol = slice(arg);
+                                // Parameters are writable and const arrays live in read-only data.
+                                if(symbol.is_const) { ABORT("Can't pass const array " << ids[std::get<my_parser::Variable>(arg).name] << " to " << name); }
+                                args.push_back(symbol.alloca);
+                                args.push_back(symbol.length);
+                            }
+                            else { args.push_back(gen_expr(arg)); }
+                        }
+                        if(args.size() != fn->arg_size()) { ABORT("Wrong number of arguments calling " << name); }
 
                         return builder.CreateCall(fn, args); // create func call IR.
                     },
@@ -400,6 +1446,10 @@ namespace llvm
                         {
                             return symbol.alloca; // return ptr address.
                         } 
+                        else if(symbol.is_const)
+                        {
+                            return cast<GlobalVariable>(symbol.alloca)->getInitializer(); // constant propagated.
+                        }
                         else
                         {
                             return builder.CreateLoad(builder.getInt32Ty(), symbol.alloca); // load value of variable to register.
@@ -475,12 +1525,9 @@ namespace llvm
                             } break;
                             case '^': { return builder.CreateXor(args[0], args[1]); } break;
                             case '|': { return builder.CreateOr(args[0], args[1]); } break;
-                            case '>':  { return i1toi32(builder.CreateICmpSGT(args[0], args[1])); } break;
-                            case '<':  { return i1toi32(builder.CreateICmpSLT(args[0], args[1])); } break;
-                            case '<=': { return i1toi32(builder.CreateICmpSLE(args[0], args[1])); } break;
-                            case '>=': { return i1toi32(builder.CreateICmpSGE(args[0], args[1])); } break;
-                            case '==': { return i1toi32(builder.CreateICmpEQ(args[0], args[1])); } break;
-                            case '!=': { return i1toi32(builder.CreateICmpNE(args[0], args[1])); } break;
+                            case '>': case '<': case '<=': case '>=': case '==': case '!=': {
+                                return i1toi32(builder.CreateICmp(comparison(op.op), args[0], args[1]));
+                            } break;
                             default: { ABORT("unhandled MathOp? " << my_tools::token_to_string(op.op)); } break;
                         }
                     },
@@ -489,4 +1536,6 @@ namespace llvm
             }
     };
 
-} // end - llvm namespace
\ No newline at end of file
+} // end - llvm namespace
+
+#endif
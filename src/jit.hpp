@@ -0,0 +1,491 @@
+// jit.hpp
+
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include "runtime.cpp" // the native code calls into the runtime, so it is linked into the compiler itself.
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "vm.hpp"
+
+namespace llvm
+{
+    // Content addressed object files for the JIT, '<dir>/<key>.o'. The key hashes the unoptimized IR the JIT
+    // hands to LLVM (the program with its VM entries and the OSR code made from the bytecode) with the target CPU, its features and the optimization level, so an unchanged program skips the optimizer and the
+    // backend and only maps the file. Entries are never stale, only unused; the directory can be wiped at any time.
+    struct DiskCache : ObjectCache
+    {
+        DiskCache(std::string dir) : dir(std::move(dir)) { sys::fs::create_directories(this->dir); }
+
+        // Where '~/.cache/complier' is ($XDG_CACHE_HOME respected).
+        static std::string default_dir()
+        {
+            SmallString<128> path;
+            if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) { path = xdg; }
+            else if (const char *home = std::getenv("HOME"); home && *home) { path = home; sys::path::append(path, ".cache"); }
+            else { return ""; }
+            sys::path::append(path, "complier");
+            return std::string(path);
+        }
+
+        // Maps the object of 'key' (not read), true if there is one. Only what is loaded here is handed to the
+        // compile layer, so the file can't appear (or vanish) between deciding to skip the optimizer and codegen.
+        bool load(StringRef key)
+        {
+            auto object = MemoryBuffer::getFile(file(key), false, false);
+            if (!object) { return false; }
+            loaded = std::move(*object);
+            loaded_key = key.str();
+            return true;
+        }
+
+        // The compile layer asks before running codegen; the module's identifier is its key.
+        std::unique_ptr<MemoryBuffer> getObject(const Module *m) override
+        {
+            if (!loaded || m->getModuleIdentifier() != loaded_key) { return nullptr; }
+            return std::move(loaded);
+        }
+
+        void notifyObjectCompiled(const Module *m, MemoryBufferRef object) override
+        {
+            // Write then rename, so concurrent runs never see half a file.
+            std::string path = file(m->getModuleIdentifier());
+            std::string tmp = path + ".tmp" + std::to_string(sys::Process::getProcessId());
+            {
+                std::error_code error;
+                raw_fd_ostream os(tmp, error);
+                if (error) { return; } // caching is best effort.
+                os << object.getBuffer();
+            }
+            if (sys::fs::rename(tmp, path)) { sys::fs::remove(tmp); }
+        }
+
+        private:
+            std::string dir;
+            std::unique_ptr<MemoryBuffer> loaded;
+            std::string loaded_key;
+            std::string file(StringRef key) { SmallString<128> path(dir); sys::path::append(path, key + ".o"); return std::string(path); }
+    };
+
+
+    // Native tier of the VM (vm.hpp). The first time a function gets hot the whole program is compiled with LLVM,
+    // -O<n> module pipeline and all, and JIT-linked into the process; from then on every hot function is just a
+    // lookup. The program's mutable globals are not defined by the module but resolved to the VM's storage, so both
+    // tiers see the same state.
+    //
+    // Each function f gets an entry '__vm.f' taking its arguments as an array of 8 byte slots (an i32, or an
+    // array's pointer followed by its length), which is all the VM needs to call any signature. A function with
+    // loops also gets '__osr.f', its bytecode translated back to IR, which takes over a running call at a loop head.
+    //
+    // With a cache directory the machine code of each program is kept in a DiskCache across runs.
+    // For profilers and debuggers the code can be announced as it is linked, with -g line tables: 'perf' writes
+    // a jitdump (~/.debug/jit, 'perf record -k 1' then 'perf inject --jit'), 'gdb' registers every object with
+    // GDB's JIT interface.
+    struct JitOptions
+    {
+        unsigned opt_level = 2;
+        std::string cache_dir;  // "" for no DiskCache.
+        bool perf = false;
+        bool gdb = false;
+        bool ast_passes = true;         // like the VM's bytecode, so both tiers run the same program.
+        std::string source = "main.c"; // the file the line tables point at.
+    };
+
+    struct Jit
+    {
+        using Entry = my_vm::Entry;
+
+        Jit(my_lexer::u8 *text, my_lexer::Interner& ids, my_vm::Program& prog, JitOptions opts = {})
+            : text(text), ids(ids), prog(prog), opts(std::move(opts))
+        {
+            if (!this->opts.cache_dir.empty()) { cache.emplace(this->opts.cache_dir); }
+        }
+
+        // Native entry of the named function.
+        Entry entry(const std::string& name)
+        {
+            if (!jit) { compile(); }
+            auto symbol = jit->lookup("__vm." + name);
+            if (!symbol) { ABORT("JIT: " << toString(symbol.takeError())); }
+            return symbol->toPtr<Entry>();
+        }
+
+        // On-stack replacement entry of the named function, null if it has none (no loops).
+        my_vm::Osr osr(const std::string& name)
+        {
+            if (!jit) { compile(); }
+            auto symbol = jit->lookup("__osr." + name);
+            if (!symbol) { consumeError(symbol.takeError()); return nullptr; }
+            return symbol->toPtr<my_vm::Osr>();
+        }
+
+        private:
+            my_lexer::u8 *text;
+            my_lexer::Interner& ids;
+            my_vm::Program& prog;
+            JitOptions opts;
+            std::unique_ptr<orc::LLJIT> jit;
+            std::optional<DiskCache> cache;
+
+            void compile()
+            {
+                InitializeNativeTarget();
+                InitializeNativeTargetAsmPrinter();
+
+                // The compiler owns its context and module, so take them over through bitcode.
+                SmallString<0> bitcode;
+                {
+                    Options compile;
+                    compile.print_ir = false;
+                    compile.output = "";
+                    compile.debug_info = opts.perf || opts.gdb;
+                    compile.ast_passes = opts.ast_passes;
+                    compile.source = opts.source;
+                    Compiler compiler{text, ids, compile};
+                    raw_svector_ostream os(bitcode);
+                    compiler.emit_bitcode(os);
+                }
+                auto ctx = std::make_unique<LLVMContext>();
+                auto mod = parseBitcodeFile(MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), "main"), *ctx);
+                if (!mod) { ABORT("JIT: " << toString(mod.takeError())); }
+
+                auto host = orc::JITTargetMachineBuilder::detectHost();
+                if (!host) { ABORT("JIT: " << toString(host.takeError())); }
+
+                orc::LLJITBuilder builder;
+                builder.setJITTargetMachineBuilder(*host);
+                if (cache)
+                {
+                    builder.setCompileFunctionCreator([&](orc::JITTargetMachineBuilder jtmb) -> Expected<std::unique_ptr<orc::IRCompileLayer::IRCompiler>> {
+                        auto tm = jtmb.createTargetMachine();
+                        if (!tm) { return tm.takeError(); }
+                        return std::make_unique<orc::TMOwningSimpleCompiler>(std::move(*tm), &*cache);
+                    });
+                }
+                if (opts.perf || opts.gdb) // the listeners hook into RuntimeDyld, so link with it instead of JITLink.
+                {
+                    builder.setObjectLinkingLayerCreator([&](orc::ExecutionSession& es, const Triple&) -> Expected<std::unique_ptr<orc::ObjectLayer>> {
+                        auto layer = std::make_unique<orc::RTDyldObjectLinkingLayer>(es, [](auto&&...) { return std::make_unique<SectionMemoryManager>(); });
+                        if (opts.gdb) { layer->registerJITEventListener(*JITEventListener::createGDBRegistrationListener()); }
+                        if (opts.perf)
+                        {
+                            JITEventListener *perf = JITEventListener::createPerfJITEventListener();
+                            if (!perf) { ABORT("This LLVM was built without perf support (LLVM_USE_PERF)"); }
+                            layer->registerJITEventListener(*perf);
+                        }
+                        return std::move(layer);
+                    });
+                }
+                auto created = builder.create();
+                if (!created) { ABORT("JIT: " << toString(created.takeError())); }
+                jit = std::move(*created);
+                (*mod)->setDataLayout(jit->getDataLayout());
+
+                define_symbols(**mod);
+                add_entries(**mod);
+                add_osr_entries(**mod);
+
+                // Keyed by the module as it is now: the OSR entries follow the bytecode's pcs and registers, which
+                // the program's own IR says nothing about.
+                bitcode.clear();
+                {
+                    raw_svector_ostream os(bitcode);
+                    WriteBitcodeToFile(**mod, os);
+                }
+                std::string key = cache_key(bitcode, *host);
+                (*mod)->setModuleIdentifier(key);
+
+                if (!cache || !cache->load(key)) // a cached object is already optimized.
+                {
+                    std::unique_ptr<TargetMachine> tm = host_target_machine();
+                    Optimizer(opts.opt_level, tm.get()).run(**mod);
+                }
+
+                if (auto error = jit->addIRModule(orc::ThreadSafeModule(std::move(*mod), std::move(ctx)))) { ABORT("JIT: " << toString(std::move(error))); }
+            }
+
+            std::string cache_key(StringRef bitcode, orc::JITTargetMachineBuilder& host)
+            {
+                SHA1 hash;
+                hash.update(bitcode);
+                hash.update(host.getTargetTriple().str());
+                hash.update(host.getCPU());
+                hash.update(host.getFeatures().getString());
+                hash.update("O" + std::to_string(opts.opt_level) + (opts.perf || opts.gdb ? "g" : ""));
+                return toHex(hash.final(), true);
+            }
+
+            // The runtime, libc (write/read/memcmp), and the VM's globals in place of the module's own.
+            void define_symbols(Module& mod)
+            {
+                orc::JITDylib& main = jit->getMainJITDylib();
+                auto process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix());
+                if (!process) { ABORT("JIT: " << toString(process.takeError())); }
+                main.addGenerator(std::move(*process));
+
+                orc::SymbolMap symbols;
+                auto define = [&](StringRef name, void *address) {
+                    symbols[jit->mangleAndIntern(name)] = {orc::ExecutorAddr::fromPtr(address), JITSymbolFlags::Exported};
+                };
+                define("__par_for", (void *)&__par_for);
+                define("__arena_alloc", (void *)&__arena_alloc);
+                define("__arena_mark", (void *)&__arena_mark);
+                define("__arena_release", (void *)&__arena_release);
+                define("__osr_fill", (void *)&osr_fill);
+                define("__osr_copy", (void *)&osr_copy);
+                define("__osr_equal", (void *)&osr_equal);
+                define("__osr_write", (void *)&osr_write);
+                define("__osr_putch", (void *)&osr_putch);
+                define("__osr_read", (void *)&osr_read);
+
+                for (auto& g : prog.globals)
+                {
+                    if (g.is_const) { continue; }         // constants are the same in both tiers.
+                    define(g.name, g.data.get());         // the VM's storage, for the OSR entries too...
+                    GlobalVariable *gv = mod.getNamedGlobal(g.name);
+                    if (!gv) { continue; }
+                    gv->setInitializer(nullptr);          // ...in place of the module's own.
+                    gv->setLinkage(GlobalValue::ExternalLinkage);
+                }
+                if (auto error = main.define(orc::absoluteSymbols(std::move(symbols)))) { ABORT("JIT: " << toString(std::move(error))); }
+            }
+
+            void add_entries(Module& mod)
+            {
+                LLVMContext& ctx = mod.getContext();
+                IRBuilder<> builder(ctx);
+                FunctionType *type = FunctionType::get(builder.getInt32Ty(), {builder.getPtrTy()}, false);
+
+                for (auto& f : prog.functions)
+                {
+                    Function *callee = mod.getFunction(f.name);
+                    if (!callee || callee->isDeclaration()) { continue; }
+
+                    Function *entry = Function::Create(type, GlobalValue::ExternalLinkage, "__vm." + f.name, mod);
+                    builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", entry));
+                    std::vector<Value *> args;
+                    for (Argument& arg : callee->args()) // little endian: an i32 is the low half of its slot.
+                    {
+                        Value *slot = builder.CreateConstGEP1_64(builder.getInt64Ty(), entry->getArg(0), arg.getArgNo());
+                        args.push_back(builder.CreateLoad(arg.getType(), slot));
+                    }
+                    builder.CreateRet(builder.CreateCall(callee, args));
+                }
+            }
+
+            // The interpreter's fill/copy/equal/write/putch/read, for the OSR entries.
+            static my_lexer::i32 osr_fill(my_lexer::i32 *data, my_lexer::i32 len, my_lexer::i32 value) { std::fill(data, data + len, value); return len; }
+            static my_lexer::i32 osr_copy(my_lexer::i32 *a, my_lexer::i32 a_len, my_lexer::i32 *b, my_lexer::i32 b_len)
+            {
+                my_lexer::i32 n = (uint32_t)a_len < (uint32_t)b_len ? a_len : b_len;
+                std::memmove(a, b, (size_t)n * sizeof(my_lexer::i32));
+                return n;
+            }
+            static my_lexer::i32 osr_equal(my_lexer::i32 *a, my_lexer::i32 a_len, my_lexer::i32 *b, my_lexer::i32 b_len)
+            {
+                return a_len == b_len && !std::memcmp(a, b, (size_t)a_len * sizeof(my_lexer::i32));
+            }
+            static void osr_write(my_lexer::i32 value) { std::printf("%d", value); }
+            static void osr_putch(my_lexer::i32 value) { std::printf("%c", value); }
+            static my_lexer::i32 osr_read() { my_lexer::i32 v = 0; if (std::scanf("%d", &v) != 1) { v = 0; } return v; }
+
+            // '__osr.f(i32 *regs, Slice *slots, i32 pc)' for every f with a loop: f's bytecode as IR, one block per
+            // instruction, entered with the interpreter's frame at the loop head pc and run to the end of the call.
+            // Registers and slots become allocas that mem2reg turns back into values. The array arguments of a call
+            // are slot numbers a LOADK put in the argument registers, found here, so every slot is known statically.
+            void add_osr_entries(Module& mod)
+            {
+                using namespace my_vm;
+                LLVMContext& ctx = mod.getContext();
+                IRBuilder<> builder(ctx);
+                Type *i32_type = builder.getInt32Ty(), *i64_type = builder.getInt64Ty(), *ptr = builder.getPtrTy();
+                StructType *slice = StructType::get(ctx, {ptr, i32_type}); // my_vm::Slice
+                FunctionType *type = FunctionType::get(i32_type, {ptr, ptr, i32_type}, false);
+                FunctionCallee arena_alloc = mod.getOrInsertFunction("__arena_alloc", ptr, i64_type);
+                FunctionCallee fill = mod.getOrInsertFunction("__osr_fill", i32_type, ptr, i32_type, i32_type);
+                FunctionCallee copy = mod.getOrInsertFunction("__osr_copy", i32_type, ptr, i32_type, ptr, i32_type);
+                FunctionCallee equal = mod.getOrInsertFunction("__osr_equal", i32_type, ptr, i32_type, ptr, i32_type);
+                FunctionCallee write = mod.getOrInsertFunction("__osr_write", builder.getVoidTy(), i32_type);
+                FunctionCallee putch = mod.getOrInsertFunction("__osr_putch", builder.getVoidTy(), i32_type);
+                FunctionCallee read = mod.getOrInsertFunction("__osr_read", i32_type);
+
+                auto global = [&](size_t index) -> Value * {
+                    my_vm::Global& g = prog.globals[index];
+                    if (GlobalVariable *gv = mod.getNamedGlobal(g.name)) { return gv; }
+                    // Not in the module (codegen propagated it): the VM's storage, or a copy of a constant.
+                    Type *value_type = g.is_array ? (Type *)ArrayType::get(i32_type, g.len) : i32_type;
+                    Constant *init = nullptr;
+                    if (g.is_const && g.is_array) { init = ConstantDataArray::get(ctx, ArrayRef<uint32_t>((uint32_t *)g.data.get(), g.len)); }
+                    else if (g.is_const)          { init = builder.getInt32(g.data[0]); }
+                    return new GlobalVariable(mod, value_type, g.is_const, g.is_const ? GlobalValue::PrivateLinkage : GlobalValue::ExternalLinkage, init, g.name);
+                };
+
+                for (my_vm::Function& f : prog.functions)
+                {
+                    std::vector<i32> heads;
+                    size_t max_args = 0;
+                    for (const Insn& in : f.code)
+                    {
+                        if (in.op == LOOP) { heads.push_back(in.a); }
+                        if (in.op != CALL) { continue; }
+                        size_t n = 0;
+                        for (bool is_array : prog.functions[in.b].array_params) { n += is_array ? 2 : 1; }
+                        max_args = std::max(max_args, n);
+                    }
+                    if (heads.empty()) { continue; }
+                    std::sort(heads.begin(), heads.end());
+                    heads.erase(std::unique(heads.begin(), heads.end()), heads.end());
+
+                    llvm::Function *osr = llvm::Function::Create(type, GlobalValue::ExternalLinkage, "__osr." + f.name, mod);
+                    BasicBlock *entry = BasicBlock::Create(ctx, "entry", osr);
+                    std::vector<BasicBlock *> blocks;
+                    for (size_t pc = 0; pc < f.code.size(); ++pc) { blocks.push_back(BasicBlock::Create(ctx, "pc" + std::to_string(pc), osr)); }
+                    BasicBlock *bad = BasicBlock::Create(ctx, "bad", osr);
+                    builder.SetInsertPoint(bad);
+                    builder.CreateUnreachable();
+
+                    // The frame, copied in.
+                    builder.SetInsertPoint(entry);
+                    std::vector<AllocaInst *> regs, data, lens;
+                    for (i32 i = 0; i < f.regs; ++i)
+                    {
+                        regs.push_back(builder.CreateAlloca(i32_type));
+                        builder.CreateStore(builder.CreateLoad(i32_type, builder.CreateConstGEP1_64(i32_type, osr->getArg(0), i)), regs.back());
+                    }
+                    for (i32 i = 0; i < f.slots; ++i)
+                    {
+                        data.push_back(builder.CreateAlloca(ptr));
+                        lens.push_back(builder.CreateAlloca(i32_type));
+                        Value *from = builder.CreateConstGEP1_64(slice, osr->getArg(1), i);
+                        builder.CreateStore(builder.CreateLoad(ptr, builder.CreateStructGEP(slice, from, 0)), data.back());
+                        builder.CreateStore(builder.CreateLoad(i32_type, builder.CreateStructGEP(slice, from, 1)), lens.back());
+                    }
+                    AllocaInst *argv = max_args ? builder.CreateAlloca(ArrayType::get(i64_type, max_args)) : nullptr;
+                    SwitchInst *dispatch = builder.CreateSwitch(osr->getArg(2), bad, heads.size());
+                    for (i32 head : heads) { dispatch->addCase(builder.getInt32(head), blocks[head]); }
+
+                    auto get = [&](i32 r) { return builder.CreateLoad(i32_type, regs[r]); };
+                    auto set = [&](i32 r, Value *v) { builder.CreateStore(v, regs[r]); };
+                    auto array = [&](i32 s) { return builder.CreateLoad(ptr, data[s]); };
+                    auto length = [&](i32 s) { return builder.CreateLoad(i32_type, lens[s]); };
+                    auto flag = [&](Value *v) { return builder.CreateZExt(v, i32_type); };
+                    auto slot_in = [&](size_t pc, i32 r) { // the slot number the lowering put in register r for the call at pc.
+                        for (size_t i = pc; i-- > 0;) { if (f.code[i].op == LOADK && f.code[i].a == r) { return f.code[i].b; } }
+                        ABORT("JIT: no slot for an array argument in " << f.name);
+                    };
+
+                    for (size_t pc = 0; pc < f.code.size(); ++pc)
+                    {
+                        const Insn& in = f.code[pc];
+                        builder.SetInsertPoint(blocks[pc]);
+                        BasicBlock *next = pc + 1 < blocks.size() ? blocks[pc + 1] : bad;
+                        auto branch = [&](Value *cond, i32 target) { builder.CreateCondBr(cond, blocks[target], next); };
+                        switch (in.op)
+                        {
+                            case LOADK:  { set(in.a, builder.getInt32(in.b)); } break;
+                            case MOV:    { set(in.a, get(in.b)); } break;
+                            case ADD:    { set(in.a, builder.CreateAdd(get(in.b), get(in.c))); } break;
+                            case SUB:    { set(in.a, builder.CreateSub(get(in.b), get(in.c))); } break;
+                            case MUL:    { set(in.a, builder.CreateMul(get(in.b), get(in.c))); } break;
+                            case DIV:    { set(in.a, builder.CreateSDiv(get(in.b), get(in.c))); } break;
+                            case REM:    { set(in.a, builder.CreateSRem(get(in.b), get(in.c))); } break;
+                            case SHL:    { set(in.a, builder.CreateShl(get(in.b), builder.CreateAnd(get(in.c), 31))); } break;
+                            case SHR:    { set(in.a, builder.CreateAShr(get(in.b), builder.CreateAnd(get(in.c), 31))); } break;
+                            case AND:    { set(in.a, builder.CreateAnd(get(in.b), get(in.c))); } break;
+                            case OR:     { set(in.a, builder.CreateOr(get(in.b), get(in.c))); } break;
+                            case XOR:    { set(in.a, builder.CreateXor(get(in.b), get(in.c))); } break;
+                            case LT:     { set(in.a, flag(builder.CreateICmpSLT(get(in.b), get(in.c)))); } break;
+                            case GT:     { set(in.a, flag(builder.CreateICmpSGT(get(in.b), get(in.c)))); } break;
+                            case LE:     { set(in.a, flag(builder.CreateICmpSLE(get(in.b), get(in.c)))); } break;
+                            case GE:     { set(in.a, flag(builder.CreateICmpSGE(get(in.b), get(in.c)))); } break;
+                            case EQ:     { set(in.a, flag(builder.CreateICmpEQ(get(in.b), get(in.c)))); } break;
+                            case NE:     { set(in.a, flag(builder.CreateICmpNE(get(in.b), get(in.c)))); } break;
+                            case NEG:    { set(in.a, builder.CreateNeg(get(in.b))); } break;
+                            case NOT:    { set(in.a, builder.CreateNot(get(in.b))); } break;
+                            case LNOT:   { set(in.a, flag(builder.CreateICmpEQ(get(in.b), builder.getInt32(0)))); } break;
+                            case JMP:
+                            case LOOP:   { builder.CreateBr(blocks[in.a]); } continue;
+                            case JZ:     { branch(builder.CreateICmpEQ(get(in.a), builder.getInt32(0)), in.b); } continue;
+                            case JNZ:    { branch(builder.CreateICmpNE(get(in.a), builder.getInt32(0)), in.b); } continue;
+                            case JLT:    { branch(builder.CreateICmpSLT(get(in.a), get(in.b)), in.c); } continue;
+                            case JGT:    { branch(builder.CreateICmpSGT(get(in.a), get(in.b)), in.c); } continue;
+                            case JLE:    { branch(builder.CreateICmpSLE(get(in.a), get(in.b)), in.c); } continue;
+                            case JGE:    { branch(builder.CreateICmpSGE(get(in.a), get(in.b)), in.c); } continue;
+                            case JEQ:    { branch(builder.CreateICmpEQ(get(in.a), get(in.b)), in.c); } continue;
+                            case JNE:    { branch(builder.CreateICmpNE(get(in.a), get(in.b)), in.c); } continue;
+                            case SWITCH:
+                            {
+                                const Switch& sw = f.switches[in.b];
+                                SwitchInst *to = builder.CreateSwitch(get(in.a), blocks[sw.otherwise]);
+                                for (size_t i = 0; i < sw.dense.size(); ++i)
+                                {
+                                    if (sw.dense[i] != sw.otherwise) { to->addCase(builder.getInt32((uint32_t)sw.lo + (uint32_t)i), blocks[sw.dense[i]]); }
+                                }
+                                for (auto& [label, target] : sw.sparse) { to->addCase(builder.getInt32(label), blocks[target]); }
+                            } continue;
+                            case GLOAD:  { set(in.a, builder.CreateLoad(i32_type, global(in.b))); } break;
+                            case GSTORE: { builder.CreateStore(get(in.b), global(in.a)); } break;
+                            case GSLICE:
+                            {
+                                builder.CreateStore(global(in.b), data[in.a]);
+                                builder.CreateStore(builder.getInt32(prog.globals[in.b].len), lens[in.a]);
+                            } break;
+                            case ANEW:
+                            {
+                                Value *len = get(in.b);
+                                Value *bytes = builder.CreateMul(builder.CreateSExt(len, i64_type), builder.getInt64(sizeof(i32)));
+                                builder.CreateStore(builder.CreateCall(arena_alloc, {bytes}), data[in.a]);
+                                builder.CreateStore(len, lens[in.a]);
+                            } break;
+                            case ALOAD:  { set(in.a, builder.CreateLoad(i32_type, builder.CreateGEP(i32_type, array(in.b), builder.CreateSExt(get(in.c), i64_type)))); } break;
+                            case ASTORE: { builder.CreateStore(get(in.c), builder.CreateGEP(i32_type, array(in.a), builder.CreateSExt(get(in.b), i64_type))); } break;
+                            case LEN:    { set(in.a, length(in.b)); } break;
+                            case FILL:   { set(in.a, builder.CreateCall(fill, {array(in.b), length(in.b), get(in.c)})); } break;
+                            case COPY:   { set(in.a, builder.CreateCall(copy, {array(in.b), length(in.b), array(in.c), length(in.c)})); } break;
+                            case EQUAL:  { set(in.a, builder.CreateCall(equal, {array(in.b), length(in.b), array(in.c), length(in.c)})); } break;
+                            case CALL: // through the callee's '__vm.' entry, like Vm::call.
+                            {
+                                my_vm::Function& callee = prog.functions[in.b];
+                                size_t n = 0;
+                                auto arg = [&](Value *v) { builder.CreateStore(v, builder.CreateConstGEP2_64(argv->getAllocatedType(), argv, 0, n++)); };
+                                for (size_t i = 0; i < callee.array_params.size(); ++i)
+                                {
+                                    i32 r = in.c + (i32)i;
+                                    if (!callee.array_params[i]) { arg(builder.CreateZExt(get(r), i64_type)); continue; }
+                                    i32 s = slot_in(pc, r);
+                                    arg(array(s));
+                                    arg(builder.CreateZExt(length(s), i64_type));
+                                }
+                                FunctionCallee target = mod.getOrInsertFunction("__vm." + callee.name, i32_type, ptr);
+                                set(in.a, builder.CreateCall(target, {argv ? (Value *)argv : ConstantPointerNull::get(PointerType::get(ctx, 0))}));
+                            } break;
+                            case RET:    { builder.CreateRet(get(in.a)); } continue;
+                            case WRITE:  { builder.CreateCall(write, {get(in.b)}); set(in.a, builder.getInt32(0)); } break;
+                            case PUTCH:  { builder.CreateCall(putch, {get(in.b)}); set(in.a, builder.getInt32(0)); } break;
+                            case READ:   { set(in.a, builder.CreateCall(read)); } break;
+                        }
+                        builder.CreateBr(next);
+                    }
+                }
+            }
+    };
+} // end - llvm namespace
+
+#endif
@@ -1,125 +1,96 @@
 #include <iostream>
 #include <climits>
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include <unordered_map>
 #include <string_view>
 #include "lexer.hpp"
+#include "scan.hpp"
 
 namespace my_lexer
 {
-    static IDManager ids;
+    static constexpr Dfa dfa;
 
-    void Lexer::init_keywords()
+    // Keywords are recognised before interning, keyed on (first char, last char, length) and confirmed with one
+    // compare, so they never touch 'ids'.
+    static constexpr uint32_t keyword_key(u8 first, u8 last, size_t len) { return first | last << 8 | len << 16; }
+
+    static constexpr PerfectHash<4> keywords = []
     {
-        auto init_keyword = [&](std::string_view name, int value)
-        {
-            i32 id = ids[name];
-            while(keywords.size() <= id) { keywords.push_back(-1); }
-            keywords[id] = value;
+        auto entry = [](std::string_view name, int token) -> PerfectHash<4>::Entry {
+            return {keyword_key(name.front(), name.back(), name.size()), token, name};
         };
-        init_keyword("let", 'let');
-        init_keyword("break", 'brk');
-        init_keyword("continue", 'cont');
-        init_keyword("return", 'ret');
-        init_keyword("loop", 'loop');
-        init_keyword("if", 'if');
-        init_keyword("else", 'else');
-    }
+        return PerfectHash<4>{
+            entry("let", 'let'),
+            entry("break", 'brk'),
+            entry("continue", 'cont'),
+            entry("return", 'ret'),
+            entry("loop", 'loop'),
+            entry("if", 'if'),
+            entry("else", 'else'),
+            entry("par", 'par'),
+            entry("reduce", 'red'),
+            entry("match", 'mtch'),
+            entry("const", 'cnst'),
+        };
+    }();
 
     int Lexer::lex() 
     { 
-        static constexpr LUT is_ws(" \n\t\r\v\f");
-        while(is_ws(*lex_iter)) { line += *lex_iter == '\n'; ++lex_iter; }
-
-        static constexpr LUT is_mono(";~^*%():{}[]+-,", true);
-        if(is_mono(*lex_iter)) { return *lex_iter++; }
-
-        static constexpr LUT is_digit("0123456789");
-        if(is_digit(*lex_iter))
+        // Run the DFA until it accepts; 'start' follows the first byte after the last whitespace/comment.
+        // States that loop on themselves (whitespace, digits, identifiers, comments) skip their whole run with one
+        // vectorized scan, so the table is only stepped a couple of times per token.
+        u8 *iter  = scan::kernels.skip_ws(lex_iter, line);
+        u8 *start = iter;
+        Dfa::u16 state = Dfa::S_START, action;
+        while(true)
         {
-            value = 0;
-            while(is_digit(*lex_iter))
+            u8 ch  = *iter;
+            action = dfa.next[state][dfa.cls[ch]];
+            if(action & Dfa::ACCEPT) { break; }
+
+            line += ch == '\n';
+            ++iter;
+            state = action;
+            switch(state)
             {
-                if(__builtin_mul_overflow(value, 10, &value)) { ABORT("D:"); }
-                if(__builtin_add_overflow(value, *lex_iter++ - '0', &value)) { ABORT("D:<"); }
+                case Dfa::S_START:   { iter = scan::kernels.skip_ws(iter, line); start = iter; } break;
+                case Dfa::S_INT:     { iter = scan::kernels.digits_end(iter); } break;
+                case Dfa::S_ID:      { iter = scan::kernels.id_end(iter);     } break;
+                case Dfa::S_COMMENT: { iter = scan::kernels.newline(iter);    } break;
+                default: break;
             }
-            return 'int';
         }
+        iter += (action & Dfa::CONSUME) != 0;
+        lex_iter = iter;
 
-        static constexpr LUT    is_id("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_");
-        static constexpr LUT still_id("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789");
-        if(is_id(*lex_iter))
+        switch(action & 0xff)
         {
-            u8 *start = lex_iter;
-            while (still_id(*lex_iter)) { ++lex_iter; }
-            u8 *end   = lex_iter;
-            value = ids[start, end];
-
-            if ( value < keywords.size() && keywords[value] > -1) { return keywords[value]; }
-            return 'id';
-        }
-
-        switch (*lex_iter)
-        {
-            case '/':
-                {
-                    if(lex_iter[1] == '/') { return lex_comment(); }
-                    return *lex_iter++;
-                }
-                break;
-            case '|':
-                {
-                    if(lex_iter[1] == '|') { lex_iter += 2; return '||';}
-                    return *lex_iter++;
-                }
-                break;
-            case '&':
-                {
-                    if(lex_iter[1] == '&') { lex_iter += 2; return '&&';}
-                    return *lex_iter++;
-                }
-                break;
-            case '=':
-                {
-                    if(lex_iter[1] == '=') { lex_iter += 2; return '==';}
-                    return *lex_iter++;
-                }
-                break;
-            case '!':
+            case Dfa::K_END:  { return 0; } break; // stays on the null terminator.
+            case Dfa::K_MONO: { return *start; } break;
+            case Dfa::K_INT:
                 {
-                    if(lex_iter[1] == '=') { lex_iter += 2; return '!=';}
-                    return *lex_iter++;
+                    if(!scan::parse_int(start, iter, value)) { ABORT("D: integer literal doesn't fit in 32 bits"); }
+                    return 'int';
                 }
                 break;
-            case '<':
+            case Dfa::K_ID:
                 {
-                    if(lex_iter[1] == '<') { lex_iter += 2; return '<<';}
-                    if(lex_iter[1] == '=') { lex_iter += 2; return '<=';}
-                    return *lex_iter++;
-                }
-                break;
-            case '>':
-                {
-                    if(lex_iter[1] == '>') { lex_iter += 2; return '>>';}
-                    if(lex_iter[1] == '=') { lex_iter += 2; return '>=';}
-                    return *lex_iter++;
+                    size_t len = iter - start;
+                    auto& keyword = keywords[keyword_key(start[0], iter[-1], len)];
+                    if(keyword.text.size() == len && !std::memcmp(keyword.text.data(), start, len)) { return keyword.value; }
+
+                    value = ids[start, iter];
+                    return 'id';
                 }
                 break;
-            default:
+            case Dfa::K_ERROR:
                 {
-                    ABORT(" D: " << (char)*lex_iter << ", " << (int)*lex_iter << "?\n");
+                    ABORT(" D: " << (char)*iter << ", " << (int)*iter << "?\n");
                 }
                 break;
+            default: { return dfa.tokens[action & 0xff]; } break; // multi-char operator.
         }
-        return *lex_iter++; 
-    }
-
-    int Lexer::lex_comment()
-    {
-        lex_iter += 2;
-        static constexpr LUT is_new_line("\n", true);
-        while(!is_new_line(*lex_iter)) { ++lex_iter; }
-        return lex();
     }
-} // END my_lexer namespace
\ No newline at end of file
+} // END my_lexer namespace
@@ -8,6 +8,15 @@
 #include <string_view>
 #include <unordered_map>
 #include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <initializer_list>
+#include <iterator>
 
 #define ABORT(...) { \
     std::cerr << "ABORT: " << __VA_ARGS__ << ", " << __LINE__ << " " << __FILE__ << "\n"; \
@@ -21,29 +30,29 @@ namespace my_lexer
     static_assert(CHAR_BIT   == 8);      // assert that 1 byte is 8 bits.
     using i32 = int32_t;                 // create an alias/type-def for an '32-bit signed integer'.
 
+    struct Interner;
+
     struct Lexer
     {
-        Lexer(u8 *lex_iter)
-            :lex_iter{lex_iter}
+        Lexer(u8 *lex_iter, Interner& ids) // identifiers are interned in ids, token values are its ids.
+            :lex_iter{lex_iter}, ids{ids}
         {
-            init_keywords();
             head = lex();
         }
 
         int  operator*()  { return head;  }
         void operator++() { head = lex(); }
         i32  get_value()  { return value; }
+        unsigned get_line() { return line + 1; } // line of the current token, from 1.
 
         private:
             u8 *lex_iter;
+            Interner& ids;
             int head;
             size_t line = 0;
             i32 value;
-            std::vector<i32> keywords;
 
             int  lex();
-            void init_keywords();
-            int  lex_comment();
     };
 
 
@@ -63,10 +72,157 @@ namespace my_lexer
         private:
             u8 lut[256];
     }; 
+
+
+
+    // Collision-free hash table over a fixed set of keys, built at compile time.
+    // slot(key) mixes 'key ^ seed' and keeps the top Bits, where the consteval constructor searches for a seed that
+    // gives every key its own slot (no seed found is a compile error). Lookups are two multiplies and one compare,
+    // no probing.
+    template<size_t Bits>
+    struct PerfectHash
+    {
+        static constexpr size_t size = 1 << Bits;
+        struct Entry { uint32_t key = 0; int value = -1; std::string_view text = {}; };
+
+        consteval PerfectHash(std::initializer_list<Entry> entries)
+        {
+            for (seed = 1; !try_seed(entries); ++seed)
+            {
+                if (seed > (1u << 16)) { throw "PerfectHash: no collision free seed, use more Bits"; }
+            }
+            for (const Entry& e : entries) { table[slot(e.key)] = e; }
+        }
+
+        constexpr size_t slot(uint32_t key) const
+        {
+            uint32_t x = (key ^ seed) * 0x9E3779B1u;
+            x ^= x >> 15;
+            return (uint32_t)(x * 0x85EBCA77u) >> (32 - Bits);
+        }
+
+        // Only the entry the key would live in: callers check it really is theirs (key, text).
+        constexpr const Entry& operator[](uint32_t key) const { return table[slot(key)]; }
+
+        private:
+            uint32_t seed = 1;
+            Entry table[size] = {};
+
+            consteval bool try_seed(std::initializer_list<Entry> entries)
+            {
+                bool used[size] = {};
+                for (const Entry& e : entries)
+                {
+                    if (used[slot(e.key)]) { return false; }
+                    used[slot(e.key)] = true;
+                }
+                return true;
+            }
+    };
+
+
+
+    // The token grammar compiled into one state transition table.
+    //
+    // Bytes are first mapped to a handful of character classes, then 'next[state][class]' either moves to another
+    // state (consuming the byte) or accepts a token kind, optionally consuming the byte that ended it. Lexer::lex()
+    // is a single loop over this table. Multi-char operators get their states from the 'multi' list below; "//"
+    // leads into the comment state. Adding an operator is an edit to 'mono'/'multi'.
+    struct Dfa
+    {
+        using u16 = uint16_t;
+
+        static constexpr std::string_view mono    = ";~^*%():{}[]+-,<>=!&|/";  // every single char token.
+        static constexpr std::string_view multi[] = {"<<", "<=", ">>", ">=", "==", "!=", "&&", "||", "=>", "//"};
+        static constexpr std::string_view comment = "//";
+
+        // Character classes; operator chars that start or continue a multi-char operator each get their own.
+        enum : u8 { C_END, C_WS, C_NL, C_DIGIT, C_ALPHA, C_ERROR, C_MONO, C_OP };
+
+        // States; one per first char of a multi-char operator follows S_OP.
+        enum : u8 { S_START, S_INT, S_ID, S_COMMENT, S_OP };
+
+        // Accepted token kinds; multi-char operators follow K_OP (their value is in 'tokens').
+        enum : u8 { K_END, K_ERROR, K_INT, K_ID, K_MONO, K_OP };
+
+        static constexpr u16 ACCEPT  = 1 << 15;
+        static constexpr u16 CONSUME = 1 << 14;
+
+        static constexpr size_t max_classes = 32, max_states = 16;
+
+        u8  cls[256]                      = {};
+        u16 next[max_states][max_classes] = {};
+        int tokens[K_OP + std::size(multi)] = {};
+
+        consteval Dfa()
+        {
+            for (int ch = 0; ch < 256; ++ch) { cls[ch] = C_ERROR; }
+            cls[0] = C_END;
+            for (u8 ch : std::string_view(" \t\r\v\f")) { cls[ch] = C_WS; }
+            cls['\n'] = C_NL;
+            for (u8 ch : std::string_view("0123456789")) { cls[ch] = C_DIGIT; }
+            for (u8 ch : std::string_view("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_")) { cls[ch] = C_ALPHA; }
+            for (u8 ch : mono) { cls[ch] = C_MONO; }
+
+            // Chars used by multi-char operators, and the prefix state for each first char.
+            u8 classes = C_OP, states = S_OP;
+            u8 prefix_state[256] = {};
+            for (std::string_view op : multi)
+            {
+                for (u8 ch : op) { if (cls[ch] == C_MONO) { cls[ch] = classes++; } }
+                if (!prefix_state[(u8)op[0]]) { prefix_state[(u8)op[0]] = states++; }
+            }
+            if (classes > max_classes || states > max_states) { throw "Dfa: grow max_classes/max_states"; }
+
+            auto accept = [](u8 kind, bool consume) { return (u16)(ACCEPT | (consume ? CONSUME : 0) | kind); };
+
+            for (u8 c = 0; c < classes; ++c)
+            {
+                // Every state falls back to accepting what it has seen so far, without consuming the new byte.
+                next[S_INT][c]     = accept(K_INT, false);
+                next[S_ID][c]      = accept(K_ID, false);
+                next[S_COMMENT][c] = S_COMMENT;
+                for (u8 s = S_OP; s < states; ++s) { next[s][c] = accept(K_MONO, false); }
+
+                next[S_START][c] = c >= C_OP ? accept(K_MONO, true) : accept(K_ERROR, false);
+            }
+            next[S_START][C_END]   = accept(K_END, false);
+            next[S_START][C_WS]    = S_START;
+            next[S_START][C_NL]    = S_START;
+            next[S_START][C_DIGIT] = S_INT;
+            next[S_START][C_ALPHA] = S_ID;
+            next[S_START][C_MONO]  = accept(K_MONO, true);
+            next[S_INT][C_DIGIT]   = S_INT;
+            next[S_ID][C_ALPHA]    = S_ID;
+            next[S_ID][C_DIGIT]    = S_ID;
+            next[S_COMMENT][C_END] = accept(K_END, false);
+            next[S_COMMENT][C_NL]  = S_START;           // the newline is consumed (and counted) here.
+
+            for (size_t i = 0; i < std::size(multi); ++i)
+            {
+                std::string_view op = multi[i];
+                u8 s = prefix_state[(u8)op[0]];
+                next[S_START][cls[(u8)op[0]]] = s;
+                if (op == comment) { next[s][cls[(u8)op[1]]] = S_COMMENT; continue; }
+
+                next[s][cls[(u8)op[1]]] = accept(K_OP + i, true);
+                tokens[K_OP + i] = (u8)op[0] << 8 | (u8)op[1]; // same value as the multi-char literal, eg. '<<'.
+            }
+        }
+    };
     
 
-    struct IDManager
+    // Identifier interner: dense ids from 0 in first seen order, each with a string_view that stays valid for the
+    // interner's lifetime. Any number of threads can intern at once (several lexers, or a pipelined parser while
+    // codegen reads names): names are spread over shards, each with its own lock, map and append-only storage, so
+    // threads rarely wait on each other and names already seen only take a shared lock. Going from an id back to
+    // its name takes no lock at all, ids index a table of blocks that are never moved or freed before the interner.
+    struct Interner
     {
+        Interner() = default;
+        Interner(const Interner&) = delete;
+        ~Interner() { for (auto& block : blocks) { delete[] block.load(); } }
+
         i32 operator[](u8 *start, u8 *end)
         {
             return (*this)[std::string_view((char *)start, end - start)];
@@ -74,26 +230,82 @@ namespace my_lexer
 
         i32 operator[](std::string_view name)
         {
-            if(string_to_id.contains(name)) { return static_cast<i32>(string_to_id[name]); }
-
-            id_to_string.emplace_back(
-                (u8 *)name.data(),
-                (u8 *)(name.data() + name.size())
-            );
-            auto& vec = id_to_string.back();
-            string_to_id[std::string_view((char *)vec.data(), vec.size())] = id_to_string.size() - 1;
-            return id_to_string.size() - 1;
+            Shard& shard = shards[std::hash<std::string_view>{}(name) % num_shards];
+            {
+                std::shared_lock lock(shard.m);
+                if (auto found = shard.ids.find(name); found != shard.ids.end()) { return found->second; }
+            }
+            std::unique_lock lock(shard.m);
+            if (auto found = shard.ids.find(name); found != shard.ids.end()) { return found->second; } // interned meanwhile.
+
+            std::string_view stored = shard.store(name);
+            i32 id = next.fetch_add(1, std::memory_order_relaxed);
+            publish(id, stored); // before the map has it, so anyone handed the id can read the name.
+            shard.ids.emplace(stored, id);
+            return id;
         }
 
-        std::string_view operator[](i32 id)
+        std::string_view operator[](i32 id) const
         {
-            auto& vec = id_to_string.at(id);
-            return std::string_view((char *)vec.data(), vec.size());
+            auto [block, index] = locate(id);
+            const Name& name = blocks[block].load(std::memory_order_acquire)[index];
+            return {name.data, name.size};
         }
 
+        size_t size() const { return next.load(std::memory_order_relaxed); }
+
         private:
-            std::vector<std::vector<u8>> id_to_string;
-            std::unordered_map<std::string_view, size_t> string_to_id;
+            static constexpr size_t num_shards = 16;
+            static constexpr size_t first_block = 256;   // block k holds first_block << k names.
+            static constexpr size_t num_blocks = 24;
+
+            struct Name { const char *data; size_t size; };
+
+            struct alignas(64) Shard // a cache line each, so neighbouring locks don't false share.
+            {
+                std::shared_mutex m;
+                std::unordered_map<std::string_view, i32> ids; // views into 'chunks'.
+                std::vector<std::unique_ptr<char[]>> chunks;
+                size_t used = 0, capacity = 0;
+
+                std::string_view store(std::string_view name)
+                {
+                    if (used + name.size() > capacity)
+                    {
+                        capacity = std::max<size_t>(4096, name.size());
+                        chunks.push_back(std::make_unique<char[]>(capacity));
+                        used = 0;
+                    }
+                    char *at = chunks.back().get() + used;
+                    std::copy(name.begin(), name.end(), at);
+                    used += name.size();
+                    return {at, name.size()};
+                }
+            };
+
+            Shard shards[num_shards];
+            std::atomic<i32> next = 0;
+            std::atomic<Name *> blocks[num_blocks] = {};
+
+            static std::pair<size_t, size_t> locate(i32 id)
+            {
+                size_t block = std::bit_width((size_t)id / first_block + 1) - 1;
+                return {block, (size_t)id - first_block * ((size_t(1) << block) - 1)};
+            }
+
+            void publish(i32 id, std::string_view name)
+            {
+                auto [block, index] = locate(id);
+                if (block >= num_blocks) { ABORT("Too many identifiers"); }
+                Name *names = blocks[block].load(std::memory_order_acquire);
+                if (!names) // first of its block, whoever gets there first allocates it.
+                {
+                    Name *fresh = new Name[first_block << block];
+                    if (blocks[block].compare_exchange_strong(names, fresh, std::memory_order_acq_rel)) { names = fresh; }
+                    else { delete[] fresh; }
+                }
+                names[index] = {name.data(), name.size()};
+            }
     };
 } // end my_lexer namespace
 
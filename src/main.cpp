@@ -1,8 +1,11 @@
 #include <iostream>
 #include "lexer.cpp"
+#include "memstats.cpp"
 #include "tools.hpp"
 #include "parser.hpp"
 #include "codegen.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
 
 // Use 'constexpr' to guarantee that the compiler constructs the 'test_case[]' array..
 // at compile time.
@@ -14,9 +17,127 @@ static my_lexer::u8 test_case[] = {
     ,0
 };
 
-int main(void)
+static int run_vm(my_lexer::u8 *text, uint64_t hot, bool jit, bool ast_passes, llvm::JitOptions jit_opts)
+{
+    my_lexer::Interner ids; // every stage reads the names through the parser's interner.
+    my_parser::Program ast = my_parser::Parser{text, ids}();
+    my_memstats::checkpoint(my_memstats::PARSE);
+    if (ast_passes) { my_memstats::Scope phase{my_memstats::PASSES}; my_passes::Pipeline{ids}.run(ast); my_memstats::checkpoint(my_memstats::PASSES); }
+    my_vm::Program prog;
+    {
+        my_memstats::Scope phase{my_memstats::CODEGEN}; // lowering to bytecode is the VM's codegen.
+        prog = my_vm::Lower{ast, ids}.out;
+        my_memstats::checkpoint(my_memstats::CODEGEN);
+    }
+
+    llvm::Jit native{text, ids, prog, std::move(jit_opts)};
+    if (prog.unsupported) // the whole program runs native then.
+    {
+        if (!jit) { ABORT("The VM can't run " << prog.unsupported); }
+        return native.entry("main")(nullptr);
+    }
+
+    my_vm::Vm::TierUp tier_up;
+    if (jit)
+    {
+        tier_up.entry = [&](const std::string& name) { return native.entry(name); };
+        tier_up.osr = [&](const std::string& name) { return native.osr(name); };
+    }
+    return my_vm::Vm{prog, hot, hot * 100, tier_up}.run();
+}
+
+// ./a.out [options] [file.c]     compiles file.c, or the embedded test case without one.
+//     -q             don't print the IR.
+//     -o <file>      bitcode output (default main.bc).
+//     -O<n>          optimize every function as soon as it's generated (with --run, the JIT's level, default 2).
+//     -g             emit DWARF line tables, so profilers and debuggers show source lines.
+//     --stream       codegen each function as soon as it's parsed, freeing its AST right away.
+//     --pipeline     like --stream, with parsing on its own thread (functions may call functions defined later).
+//     --split <p>    emit each function to <p>.<n>.o and drop it from the module (link those with the bitcode).
+//     --no-ast-opt   skip the AST passes (constant folding, const calls, dead code).
+//     --pass-stats   print what each AST pass changed and its time.
+//     --report <f>   print per-function IR statistics and write LLVM's optimization remarks to <f> (YAML).
+//     --profile      count calls and cycles of every function, written to prof.out at exit (see prof_report.cpp).
+//     --profile-loops  like --profile, and count the trips of every loop too.
+//     --stack-limit <bytes>  arrays bigger than this go in the arena instead of the stack frame (default 16K).
+//     --frame-report   print the biggest stack frames.
+//     --run          don't compile: interpret file.c on the bytecode VM, hot functions tier up to LLVM native code.
+//     --hot <n>      calls (or n * 100 loop iterations) that make a function hot (default 1000).
+//     --no-jit       with --run, only ever interpret.
+//     --jit-cache <d>  keep the JIT's machine code in <d> across runs (default ~/.cache/complier).
+//     --no-jit-cache   always optimize and codegen from scratch.
+//     --jit-perf     write a perf jitdump for the JIT's code (perf record -k 1, then perf inject --jit).
+//     --jit-gdb      register the JIT's code with GDB, with line tables.
+//     --mem-report   count allocations per phase (parse, ast passes, codegen, optimize, emit) and what each step added to RSS.
+int main(int argc, char **argv)
 {
     //my_parser::Parser{test_case}();
-    llvm::Compiler{(my_lexer::u8 *)test_case};
+    llvm::Options opts;
+    const char *input = nullptr;
+    bool run = false, jit = true, mem_report = false;
+    uint64_t hot = 1000;
+    llvm::JitOptions jit_opts;
+    jit_opts.cache_dir = llvm::DiskCache::default_dir();
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if      (arg == "-q")                       { opts.print_ir = false; }
+        else if (arg == "-o" && i + 1 < argc)       { opts.output = argv[++i]; }
+        else if (arg.starts_with("-O"))             { opts.opt_level = jit_opts.opt_level = std::atoi(argv[i] + 2); }
+        else if (arg == "-g")                       { opts.debug_info = true; }
+        else if (arg == "--stream")                 { opts.streaming = true; }
+        else if (arg == "--pipeline")               { opts.pipelined = true; }
+        else if (arg == "--split" && i + 1 < argc)  { opts.split = argv[++i]; }
+        else if (arg == "--no-ast-opt")             { opts.ast_passes = false; }
+        else if (arg == "--pass-stats")             { opts.pass_stats = true; }
+        else if (arg == "--report" && i + 1 < argc) { opts.report = argv[++i]; }
+        else if (arg == "--profile")                { opts.profile = true; }
+        else if (arg == "--profile-loops")          { opts.profile = opts.profile_loops = true; }
+        else if (arg == "--stack-limit" && i + 1 < argc) { opts.stack_limit = std::strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--frame-report")           { opts.frame_report = true; }
+        else if (arg == "--run")                    { run = true; }
+        else if (arg == "--hot" && i + 1 < argc)    { hot = std::strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--no-jit")                 { jit = false; }
+        else if (arg == "--jit-cache" && i + 1 < argc) { jit_opts.cache_dir = argv[++i]; }
+        else if (arg == "--no-jit-cache")           { jit_opts.cache_dir.clear(); }
+        else if (arg == "--jit-perf")               { jit_opts.perf = true; }
+        else if (arg == "--jit-gdb")                { jit_opts.gdb = true; }
+        else if (arg == "--mem-report")             { mem_report = true; }
+        else if (arg.starts_with("-"))              { ABORT("Unknown option " << arg); }
+        else                                        { input = argv[i]; opts.source = input; }
+    }
+
+    if (mem_report) { my_memstats::enable(); }
+
+    std::vector<my_lexer::u8> text;
+    if (input)
+    {
+        text = my_tools::read_file(input);
+        if (text.empty()) { ABORT("Can't open " << input); }
+    }
+    my_lexer::u8 *source = input ? text.data() : test_case;
+
+    if (run)
+    {
+        jit_opts.source = opts.source;
+        jit_opts.ast_passes = opts.ast_passes;
+        int status = run_vm(source, hot, jit, opts.ast_passes, jit_opts);
+        if (mem_report) { my_memstats::report(std::cerr); }
+        return status;
+    }
+
+    int64_t held, held_rss;
+    {
+        int64_t before = my_memstats::live, before_rss = mem_report ? my_memstats::rss() : 0;
+        my_lexer::Interner ids;
+        llvm::Compiler compiler{source, ids, opts};
+        held = my_memstats::live - before; // the names, the AST and what LLVM got through operator new...
+        held_rss = mem_report ? my_memstats::rss() - before_rss : 0; // ...and its malloc'd buffers too.
+    }
+    if (mem_report)
+    {
+        my_memstats::report(std::cerr);
+        fprintf(stderr, "held by the compiler before emitting: %.2f MB through operator new, rss +%.2f MB\n", held / double(1 << 20), held_rss / double(1 << 20));
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,53 @@
+// memstats.cpp
+//
+// Replaces the global operator new and delete (every form) with malloc/free plus the counting of memstats.hpp.
+// A program has only one of each, so this is only included by main.cpp. Sizes are malloc_usable_size(), the same
+// on both sides whether or not delete is told the size.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include "memstats.hpp"
+
+static void *allocate(size_t size, size_t align, bool nothrow)
+{
+    if (!size) { size = 1; }
+    void *p = align > alignof(std::max_align_t) ? aligned_alloc(align, (size + align - 1) / align * align) : malloc(size);
+    if (!p)
+    {
+        if (nothrow) { return nullptr; }
+        throw std::bad_alloc();
+    }
+    if (my_memstats::enabled.load(std::memory_order_relaxed)) { my_memstats::on_alloc(malloc_usable_size(p)); } // not a cost when off.
+    return p;
+}
+
+static void release(void *p)
+{
+    if (!p) { return; }
+    if (my_memstats::enabled.load(std::memory_order_relaxed)) { my_memstats::on_free(malloc_usable_size(p)); }
+    free(p);
+}
+
+void *operator new(size_t size)                                              { return allocate(size, 0, false); }
+void *operator new[](size_t size)                                            { return allocate(size, 0, false); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept              { return allocate(size, 0, true); }
+void *operator new[](size_t size, const std::nothrow_t&) noexcept            { return allocate(size, 0, true); }
+void *operator new(size_t size, std::align_val_t a)                          { return allocate(size, (size_t)a, false); }
+void *operator new[](size_t size, std::align_val_t a)                        { return allocate(size, (size_t)a, false); }
+void *operator new(size_t size, std::align_val_t a, const std::nothrow_t&) noexcept   { return allocate(size, (size_t)a, true); }
+void *operator new[](size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return allocate(size, (size_t)a, true); }
+
+void operator delete(void *p) noexcept                                       { release(p); }
+void operator delete[](void *p) noexcept                                     { release(p); }
+void operator delete(void *p, size_t) noexcept                               { release(p); }
+void operator delete[](void *p, size_t) noexcept                             { release(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept                { release(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept              { release(p); }
+void operator delete(void *p, std::align_val_t) noexcept                     { release(p); }
+void operator delete[](void *p, std::align_val_t) noexcept                   { release(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept             { release(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept           { release(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept   { release(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
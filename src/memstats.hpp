@@ -0,0 +1,141 @@
+// memstats.hpp
+
+#ifndef MEMSTATS_HPP
+#define MEMSTATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <unistd.h>
+
+namespace my_memstats
+{
+    // Memory accounting (--mem-report): every operator new/delete of the process (memstats.cpp replaces them) is
+    // counted against the phase of the thread doing it, along with the live bytes of the whole process and their
+    // peak. Threads start out in OTHER; a Scope puts the thread in a phase until it ends. Frees count against the
+    // phase freeing, so a phase's net bytes are what it left behind for the later ones (the AST for parse, the IR
+    // for codegen).
+    //
+    // That is only what goes through operator new. Much of LLVM doesn't: SmallVector and DenseMap buffers come
+    // from malloc/realloc (safe_malloc), so the context's and the module's memory is mostly missing from those
+    // counts. For that, the resident set is sampled at checkpoints, the boundaries of the compiler's big steps,
+    // and what it grew by since the previous one is put on the step's phase ('rss +MB').
+    enum Phase { OTHER, PARSE, PASSES, CODEGEN, OPTIMIZE, EMIT, PHASES };
+    static constexpr const char *phase_names[PHASES] = {"other", "parse", "ast passes", "codegen", "optimize", "emit"};
+
+    struct Counters
+    {
+        std::atomic<uint64_t> allocs, frees, allocated, freed;
+        std::atomic<int64_t> peak;     // most live bytes (of the process) seen while in the phase.
+        std::atomic<int64_t> rss;      // resident bytes gained by the steps checkpointed as the phase.
+    };
+
+    static std::atomic<bool> enabled = false;   // off: the hooks return right away.
+    static Counters counters[PHASES];
+    static std::atomic<int64_t> live, peak;     // bytes; allocations made before counting was enabled aren't in.
+    static std::atomic<int> peak_phase;
+    static std::atomic<uint64_t> last_rss;      // at the previous checkpoint.
+    static thread_local Phase current = OTHER;
+
+    static void raise(std::atomic<int64_t>& max, int64_t value)
+    {
+        for (int64_t seen = max.load(std::memory_order_relaxed); value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed);) {}
+    }
+
+    // Called by memstats.cpp with the usable size of the block.
+    static void on_alloc(size_t size)
+    {
+        if (!enabled.load(std::memory_order_relaxed)) { return; }
+        Counters& c = counters[current];
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.allocated.fetch_add(size, std::memory_order_relaxed);
+        int64_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+        raise(c.peak, now);
+        if (now > peak.load(std::memory_order_relaxed)) { raise(peak, now); peak_phase.store(current, std::memory_order_relaxed); }
+    }
+
+    static void on_free(size_t size)
+    {
+        if (!enabled.load(std::memory_order_relaxed)) { return; }
+        Counters& c = counters[current];
+        c.frees.fetch_add(1, std::memory_order_relaxed);
+        c.freed.fetch_add(size, std::memory_order_relaxed);
+        live.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    // Resident set size now, and its high water mark (VmHWM), from /proc. 0 where there is no /proc.
+    static uint64_t rss()
+    {
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (!statm) { return 0; }
+        unsigned long long pages = 0;
+        if (fscanf(statm, "%*llu %llu", &pages) != 1) { pages = 0; }
+        fclose(statm);
+        return pages * sysconf(_SC_PAGESIZE);
+    }
+
+    static uint64_t peak_rss()
+    {
+        FILE *status = fopen("/proc/self/status", "r");
+        if (!status) { return 0; }
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), status)) { if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) { break; } }
+        fclose(status);
+        return kb * 1024;
+    }
+
+    static void enable()
+    {
+        last_rss = rss();
+        enabled = true;
+    }
+
+    // Ends a step of the compile: the resident set's growth since the previous checkpoint goes to phase. Reads
+    // /proc, so it is only called between big steps (a whole parse, all of codegen), never per function or name.
+    static void checkpoint(Phase phase)
+    {
+        if (!enabled.load(std::memory_order_relaxed)) { return; }
+        uint64_t now = rss();
+        counters[phase].rss.fetch_add((int64_t)now - (int64_t)last_rss.exchange(now, std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // Puts the calling thread in phase until the end of the scope; scopes nest. Only a thread local is touched.
+    struct Scope
+    {
+        Scope(Phase phase) : saved(current) { current = phase; }
+        ~Scope() { current = saved; }
+        Scope(const Scope&) = delete;
+
+        private:
+            Phase saved;
+    };
+
+    static void report(std::ostream& os)
+    {
+        char line[256];
+        auto mb = [](double bytes) { return bytes / (1 << 20); };
+        os << "memory           allocs      frees   allocated MB    freed MB     net MB   peak live MB      rss +MB\n";
+        uint64_t allocs = 0, frees = 0, allocated = 0, freed = 0;
+        for (int p = 0; p < PHASES; ++p)
+        {
+            Counters& c = counters[p];
+            if (!c.allocs && !c.frees && !c.rss) { continue; }
+            allocs += c.allocs; frees += c.frees; allocated += c.allocated; freed += c.freed;
+            snprintf(line, sizeof(line), "%-12s %10llu %10llu %14.2f %11.2f %10.2f %14.2f %+12.2f\n", phase_names[p],
+                     (unsigned long long)c.allocs, (unsigned long long)c.frees, mb(c.allocated), mb(c.freed),
+                     mb((double)c.allocated - (double)c.freed), mb(c.peak), mb(c.rss));
+            os << line;
+        }
+        snprintf(line, sizeof(line), "%-12s %10llu %10llu %14.2f %11.2f %10.2f\n", "total", (unsigned long long)allocs,
+                 (unsigned long long)frees, mb(allocated), mb(freed), mb((double)allocated - (double)freed));
+        os << line;
+        snprintf(line, sizeof(line), "peak live %.2f MB (during %s), live now %.2f MB, rss now %.2f MB, peak rss %.2f MB\n",
+                 mb(peak), phase_names[peak_phase], mb(live), mb(rss()), mb(peak_rss()));
+        os << line;
+    }
+} // END my_memstats namespace
+
+#endif
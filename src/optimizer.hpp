@@ -0,0 +1,66 @@
+// optimizer.hpp
+
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/OptimizationLevel.h"
+
+namespace llvm
+{
+    // LLVM's new pass manager set up once, run on single functions (streaming) or whole modules.
+    struct Optimizer
+    {
+        Optimizer(unsigned opt_level, TargetMachine *tm = nullptr)
+            : level(to_level(opt_level)),
+              pb(tm)
+        {
+            pb.registerModuleAnalyses(mam);
+            pb.registerCGSCCAnalyses(cgam);
+            pb.registerFunctionAnalyses(fam);
+            pb.registerLoopAnalyses(lam);
+            pb.crossRegisterProxies(lam, fam, cgam, mam);
+        }
+
+        // Function simplification pipeline (SROA, mem2reg, instcombine, simplifycfg, loop passes, ...).
+        // Cheap enough to run on each function right after it was generated, while its IR is still in cache.
+        void run(Function& f)
+        {
+            if (level == OptimizationLevel::O0) { return; }
+            if (!function_pm) { function_pm = pb.buildFunctionSimplificationPipeline(level, ThinOrFullLTOPhase::None); }
+            function_pm->run(f, fam);
+            fam.clear(f, f.getName()); // don't keep analyses of functions we are done with.
+        }
+
+        // The full -O<n> module pipeline.
+        void run(Module& m)
+        {
+            ModulePassManager mpm = level == OptimizationLevel::O0 ? pb.buildO0DefaultPipeline(level) : pb.buildPerModuleDefaultPipeline(level);
+            mpm.run(m, mam);
+        }
+
+        private:
+            OptimizationLevel level;
+            PassBuilder pb;
+            LoopAnalysisManager lam;
+            FunctionAnalysisManager fam;
+            CGSCCAnalysisManager cgam;
+            ModuleAnalysisManager mam;
+            std::optional<FunctionPassManager> function_pm;
+
+            static OptimizationLevel to_level(unsigned opt_level)
+            {
+                switch (opt_level)
+                {
+                    case 0:  { return OptimizationLevel::O0; } break;
+                    case 1:  { return OptimizationLevel::O1; } break;
+                    case 2:  { return OptimizationLevel::O2; } break;
+                    default: { return OptimizationLevel::O3; } break;
+                }
+            }
+    };
+} // end - llvm namespace
+
+#endif
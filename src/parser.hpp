@@ -5,9 +5,11 @@
 
 #include <variant>
 #include "lexer.hpp"
+#include "memstats.hpp"
 #include <vector>
 #include <optional>
 #include <iostream>
+#include <unordered_set>
 
 
 namespace my_parser
@@ -55,11 +57,30 @@ namespace my_parser
     struct Block { std::vector<Stmt> body; };
     struct Break {};
     struct Continue {};
-    struct Loop { Block body; }; 
+
+    /*
+    STMT -> 'loop' HINT* BLOCK
+    HINT -> ('unroll' | 'vectorize' | 'interleave') '(' INT ')'
+    */
+    struct LoopHints { my_lexer::i32 unroll = 0, vectorize = 0, interleave = 0; }; // 0: up to the optimizer, 1: don't.
+    struct Loop { Block body; LoopHints hints; }; 
     struct If { std::vector<Expr> cond; Block body; std::optional<Block> else_body; };
     struct Nop {};
     
 
+    /*
+    STMT -> 'par' id '=' EXPR ',' EXPR ('reduce' OP id)? BLOCK
+    */
+    struct Par { my_lexer::i32 index; Expr lo, hi; int op; my_lexer::i32 acc; Block body; }; // iterations of [lo, hi) run across cores.
+                                                                                           // op == 0 means no reduction, otherwise acc is combined with op.
+
+    /*
+    STMT -> 'match' EXPR '{' ARM* ('_' '=>' BLOCK)? '}'
+    ARM  -> LABEL ('|' LABEL)* '=>' BLOCK
+    */
+    struct Arm { std::vector<my_lexer::i32> labels; Block body; };
+    struct Match { Expr value; std::vector<Arm> arms; std::optional<Block> otherwise; }; // no fall through between arms.
+
     struct Let { Expr body; };
     struct Assign { Expr lhs, rhs; };
 
@@ -72,28 +93,71 @@ namespace my_parser
 
 
 
-    struct Stmt : public Var<Block, Break, Continue, Loop, If, Nop, Expr, Let, Assign, Return> {
-        using Var<Block, Break, Continue, Loop, If, Nop, Expr, Let ,Assign, Return>::Var;
+    struct Stmt : public Var<Block, Break, Continue, Loop, If, Nop, Expr, Let, Assign, Return, Par, Match> {
+        using Var<Block, Break, Continue, Loop, If, Nop, Expr, Let ,Assign, Return, Par, Match>::Var;
+        unsigned line = 0; // source line of its first token (0 if a pass made it up).
     };
 
 
 
     /*
-    FUNCTION -> id '(' var (',' var)* ')' BLOCK
+    FUNCTION -> 'const'? id '(' var (',' var)* ')' BLOCK
     */
-   struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; }; // params variable or array (value).
+   struct Func { my_lexer::i32 name; std::vector<Expr> params; Block body; unsigned line = 0; bool is_const = false; }; // params variable or array (value).
+                                                                                                                      // const: calls with constant arguments are evaluated at compile time (passes.hpp).
+
+
+
+    /*
+    GLOBAL -> ('let' | 'const') id ('[' EXPR? ']')? ('=' INIT)? ';'
+    INIT   -> EXPR | '{' (EXPR (',' EXPR)*)? '}'
+    */
+    struct Global
+    {
+        bool is_const;             // const: read only, its value known at compile time.
+        my_lexer::i32 name;
+        bool is_array;
+        std::optional<Expr> size;  // arrays: from the initializer list if left out.
+        std::vector<Expr> init;    // constant expressions, missing elements are 0.
+    };
+
+    struct TopLevel : public Var<Func, Global> { using Var<Func, Global>::Var; };
 
 
 
     /*
-    PROGRAM -> FUNCTION*
+    PROGRAM -> (FUNCTION | GLOBAL)*
     */
-    struct Program { std::vector<Func> body; }; // a collection of functions.
+    struct Program { std::vector<Func> body; std::vector<Global> globals; }; // a collection of functions (and the globals they use).
+
+    // Binary operators: binding power (higher binds tighter, 0 = not a binary operator) and associativity.
+    // Adding an operator is a line here (plus its codegen).
+    struct BindingPower { int bind; bool right; };
+
+    static consteval my_lexer::PerfectHash<6>::Entry binary_op(int token, int bind, bool right = false)
+    {
+        return {(uint32_t)token, bind << 1 | right};
+    }
+
+    static constexpr my_lexer::PerfectHash<6> binary_ops = {
+        binary_op('||', 1),
+        binary_op('&&', 2),
+        binary_op('<', 3), binary_op('>', 3), binary_op('<=', 3), binary_op('>=', 3), binary_op('==', 3), binary_op('!=', 3),
+        binary_op('+', 4), binary_op('-', 4), binary_op('^', 4), binary_op('|', 4),
+        binary_op('<<', 5), binary_op('>>', 5), binary_op('&', 5), binary_op('*', 5), binary_op('/', 5), binary_op('%', 5),
+    };
+
+    static constexpr BindingPower binding_power(int token)
+    {
+        auto& entry = binary_ops[(uint32_t)token];
+        if(entry.key != (uint32_t)token || entry.value < 0) { return {0, false}; }
+        return {entry.value >> 1, (entry.value & 1) != 0};
+    }
 
     struct Parser
     {
-        Parser(my_lexer::u8 *text)
-            : lex{text}
+        Parser(my_lexer::u8 *text, my_lexer::Interner& ids)
+            : ids{ids}, lex{text, ids}
         {}
         
         my_lexer::i32 expect (int token)
@@ -105,8 +169,14 @@ namespace my_parser
             }
 
         Program operator()() { return parse_program(); }
+
+        // Streaming: hands every function and global to on_item (as a TopLevel) as soon as it is parsed instead of
+        // building a Program. It is moved in, so its AST is freed when on_item is done with it.
+        template<typename OnItem>
+        void operator()(OnItem&& on_item) { while(*lex) { on_item(parse_top_level()); } }
         
         private:
+            my_lexer::Interner& ids;
             my_lexer::Lexer lex;
 
 
@@ -117,19 +187,80 @@ namespace my_parser
             Program parse_program()
             {
                 Program p;
-                while(*lex) { p.body.push_back(parse_function()); } // FUNCTION*
-                return p;                                           // generate struct Program {body}
+                while(*lex)                                         // (FUNCTION | GLOBAL)*
+                {
+                    parse_top_level()(
+                        [&](Func& f)   { p.body.push_back(std::move(f)); },
+                        [&](Global& g) { p.globals.push_back(std::move(g)); }
+                    );
+                }
+                return p;                                           // generate struct Program {body, globals}
+            }
+
+            TopLevel parse_top_level()
+            {
+                my_memstats::Scope phase{my_memstats::PARSE};
+                unsigned line = lex.get_line();
+                bool is_const = *lex == 'cnst';
+                if (*lex == 'let' || is_const) { ++lex; }      // 'let' | 'const'
+                else { return parse_function(line, expect('id'), false); }
+
+                my_lexer::i32 name = expect('id');
+                if (is_const && *lex == '(') { return parse_function(line, name, true); } // 'const' FUNCTION
+                return parse_global(is_const, name);
+            }
+
+
+
+            // GLOBAL -> ('let' | 'const') id ('[' EXPR? ']')? ('=' INIT)? ';'
+            // INIT   -> EXPR | '{' (EXPR (',' EXPR)*)? '}'
+            Global parse_global(bool is_const, my_lexer::i32 name) // after the 'let'/'const' and the name.
+            {
+                Global g{is_const, name, false, std::nullopt, {}};
+                if (*lex == '[')
+                {
+                    ++lex;                                     // '['
+                    g.is_array = true;
+                    if (*lex != ']') { g.size = parse_expr(); }
+                    expect(']');
+                }
+
+                if (*lex == '=')
+                {
+                    ++lex;                                     // '='
+                    if (*lex == '{')
+                    {
+                        if (!g.is_array) { ABORT("Initializer list for variable " << ids[g.name]); }
+                        ++lex;                                 // '{'
+                        while (*lex != '}')
+                        {
+                            g.init.push_back(parse_expr());
+                            if (*lex != ',') { break; }
+                            ++lex;                             // ','
+                        }
+                        expect('}');
+                    }
+                    else
+                    {
+                        if (g.is_array) { ABORT("Array " << ids[g.name] << " needs an initializer list"); }
+                        g.init.push_back(parse_expr());
+                    }
+                }
+                expect(';');
+
+                if (g.is_array && !g.size && g.init.empty()) { ABORT("Array " << ids[g.name] << " needs a size or an initializer list"); }
+                if (g.is_const && g.init.empty()) { ABORT("const " << ids[g.name] << " needs a value"); }
+                return g;
             }
             
 
 
 
             /*
-            FUNCTION -> id '(' var (',' var)* ')' BLOCK
+            FUNCTION -> 'const'? id '(' var (',' var)* ')' BLOCK
             */
-            Func parse_function()
+            Func parse_function(unsigned line, my_lexer::i32 name, bool is_const) // after the 'const' and the id.
             {
-                my_lexer::i32 name = expect('id');             // id
                 std::vector<Expr> params;
                 expect('(');                                   // '('
                 while (*lex != ')')                            // while params (get vars)
@@ -140,7 +271,7 @@ namespace my_parser
                 }
                 expect(')');                                   // ')'
                 Block body = parse_block();                    // BLOCK (stmts or empty. parse_block() handles).
-                return {name, std::move(params), std::move(body)};       // generate struc func {name, params, body}
+                return {name, std::move(params), std::move(body), line, is_const}; // generate struc func {name, params, body}
             }
 
 
@@ -151,7 +282,12 @@ namespace my_parser
             {
                 expect('{');
                 std::vector<Stmt> body;
-                while(*lex && *lex != '}') { body.push_back(parse_stmt()); }  
+                while(*lex && *lex != '}')
+                {
+                    unsigned line = lex.get_line();
+                    body.push_back(parse_stmt());
+                    body.back().line = line;                   // for debug info.
+                }
                 expect('}');
                 return Block{std::move(body)};
             }
@@ -159,7 +295,7 @@ namespace my_parser
             /*
             STMT -> 'break' ';'
                 | 'continue' ';'
-                | 'loop' BLOCK
+                | 'loop' HINT* BLOCK
                 |  BLOCK
                 | ';'
                 | 'if' EXPR BLOCK ('else' BLOCK)?
@@ -167,6 +303,8 @@ namespace my_parser
                 | 'let' VARIABLE ';'
                 |  EXPR '=' EXPR ';'
                 |  'return' EXPR ';'
+                |  'par' id '=' EXPR ',' EXPR ('reduce' OP id)? BLOCK
+                |  'match' EXPR '{' ARM* ('_' '=>' BLOCK)? '}'
             */
             Stmt parse_stmt() 
             {
@@ -180,7 +318,7 @@ namespace my_parser
                     } break;
                     case 'brk':  { ++lex; expect(';'); return Break{};    } break; // 'break' ';'
                     case 'cont': { ++lex; expect(';'); return Continue{}; } break; // 'continue' ';'
-                    case 'loop': { ++lex; return Loop{parse_block()};     } break; // 'loop' BLOCK
+                    case 'loop': { ++lex; LoopHints hints = parse_loop_hints(); return Loop{parse_block(), hints}; } break; // 'loop' HINT* BLOCK
                     case '{':    { return parse_block();  } break;                 //  BLOCK
                     case ';':    { ++lex; return Nop{};   } break;                 //  ';'
                     case 'if':                                                     //  'if' EXPR BLOCK ('else' BLOCK)? 
@@ -197,6 +335,8 @@ namespace my_parser
                         return If{{std::move(cond)}, std::move(body), std::move(else_body)}; // return If struct.
                     } break;
                     case 'let': { ++lex; return Let{parse_variable()}; } break;   // 'let VARIABLE ';'
+                    case 'par': { ++lex; return parse_par(); } break;             // 'par' id '=' EXPR ',' EXPR ...
+                    case 'mtch': { ++lex; return parse_match(); } break;          // 'match' EXPR '{' ARM* '}'
                     default:                                                       // EXPR ';'
                     {
                         auto lhs = parse_expr();
@@ -216,7 +356,105 @@ namespace my_parser
 
 
 
-            Expr parse_expr() { return parse_or(); }
+            Expr parse_expr() { return parse_binary(1); }
+
+
+            // PAR -> id '=' EXPR ',' EXPR ('reduce' OP id)? BLOCK
+            // OP  -> '+' | '*' | '&' | '|' | '^' | 'min' | 'max'
+            Par parse_par()
+            {
+                my_lexer::i32 index = expect('id');             // loop index (private to each iteration).
+                expect('=');
+                Expr lo = parse_expr();                          // first index.
+                expect(',');
+                Expr hi = parse_expr();                          // one past the last index.
+
+                int op = 0;
+                my_lexer::i32 acc = -1;
+                if (*lex == 'red')
+                {
+                    ++lex;                                       // 'reduce'
+                    switch (*lex)
+                    {
+                        case '+': case '*': case '&': case '|': case '^': { op = *lex; ++lex; } break;
+                        case 'id':
+                        {
+                            // min/max are not keywords, they only mean something after 'reduce'.
+                            std::string_view name = ids[lex.get_value()];
+                            if      (name == "min") { op = 'min'; }
+                            else if (name == "max") { op = 'max'; }
+                            else    { ABORT("Unknown reduction " << name); }
+                            ++lex;
+                        } break;
+                        default: { ABORT("Expected a reduction operator after reduce"); } break;
+                    }
+                    acc = expect('id');                          // the variable reduced into.
+                }
+
+                Block body = parse_block();
+                return Par{index, std::move(lo), std::move(hi), op, acc, std::move(body)};
+            }
+
+
+            // MATCH -> EXPR '{' ARM* ('_' '=>' BLOCK)? '}'
+            // ARM   -> LABEL ('|' LABEL)* '=>' BLOCK
+            // LABEL -> '-'? INT
+            Match parse_match()
+            {
+                Match match{parse_expr(), {}, std::nullopt};
+                std::unordered_set<my_lexer::i32> seen;
+                expect('{');
+                while (*lex != '}')
+                {
+                    // '_' is not a keyword, it only means "anything else" here.
+                    if (*lex == 'id' && ids[lex.get_value()] == "_")
+                    {
+                        if (match.otherwise) { ABORT("match has two '_' arms"); }
+                        ++lex;                                   // '_'
+                        expect('=>');
+                        match.otherwise = parse_block();
+                        continue;
+                    }
+
+                    Arm arm;
+                    while (true)
+                    {
+                        bool negative = *lex == '-';
+                        if (negative) { ++lex; }                 // '-'?
+                        my_lexer::i32 label = expect('int');     // INT
+                        if (negative) { label = (my_lexer::i32)(0u - (uint32_t)label); }
+                        if (!seen.insert(label).second) { ABORT("match has two arms for " << label); }
+                        arm.labels.push_back(label);
+                        if (*lex != '|') { break; }
+                        ++lex;                                   // '|'
+                    }
+                    expect('=>');
+                    arm.body = parse_block();
+                    match.arms.push_back(std::move(arm));
+                }
+                expect('}');
+                return match;
+            }
+
+
+            // HINT -> ('unroll' | 'vectorize' | 'interleave') '(' INT ')'
+            // Like '_', the hint names are not keywords: they only mean something between 'loop' and its block.
+            LoopHints parse_loop_hints()
+            {
+                LoopHints hints;
+                while (*lex == 'id')
+                {
+                    std::string_view name = ids[lex.get_value()];
+                    my_lexer::i32 *hint = name == "unroll" ? &hints.unroll : name == "vectorize" ? &hints.vectorize : name == "interleave" ? &hints.interleave : nullptr;
+                    if (!hint) { ABORT("Unknown loop hint " << name); }
+                    ++lex;                                       // hint
+                    expect('(');
+                    *hint = expect('int');                       // INT
+                    if (*hint < 1) { ABORT("Loop hint " << name << " needs a count of at least 1"); }
+                    expect(')');
+                }
+                return hints;
+            }
 
 
             // VARIABLE -> ID ('[' EXPR ']')?
@@ -305,88 +543,21 @@ namespace my_parser
                 }
             }
 
-            Expr parse_mul()
+            /*
+            EXPR -> UNARY (BINOP UNARY)*      (precedence and associativity from binary_ops)
+            */
+            Expr parse_binary(int min_power)
             {
                 Expr lhs = parse_unary();
                 while(1)
                 {
-                    switch (*lex)
-                    {
-                        case '<<': case '>>': case '&': case '*': case '/': case '%':
-                        {
-                            int op = *lex;
-                            ++lex;
-                            Expr rhs = parse_unary();
-                            lhs = MathOp{op, {std::move(lhs), std::move(rhs)}};
-                        }
-                        break;
-                        default: { return lhs; } break;
-                    }
-                }
-            }
-
-            Expr parse_add()
-            {
-                Expr lhs = parse_mul();
-                while(1)
-                {
-                    switch (*lex)
-                    {
-                        case '+': case '-': case '^': case '|':
-                        {
-                            int op = *lex;
-                            ++lex;
-                            Expr rhs = parse_mul();
-                            lhs = MathOp{op, {std::move(lhs), std::move(rhs)}};
-                        }
-                        break;
-                        default: { return lhs; } break;
-                    }
-                }
-            }
-
-            Expr parse_rel() 
-            {
-                Expr lhs = parse_add();
-                while(1)
-                {
-                    switch (*lex)
-                    {
-                        case '<': case '>': case '<=': case '>=': case '==': case '!=':
-                        {
-                            int op = *lex;
-                            ++lex;
-                            Expr rhs = parse_add();
-                            lhs = MathOp{op, {std::move(lhs), std::move(rhs)}};
-                        }
-                        break;
-                        default: { return lhs; } break;
-                    }
-                }
-            }
-
-            Expr parse_and()
-            {
-                Expr lhs = parse_rel();
-                while(*lex == '&&')
-                {
-                    ++lex;
-                    Expr rhs = parse_rel();
-                    lhs = MathOp{'&&', {std::move(lhs), std::move(rhs)}};
-                }
-                return lhs;
-            }
-
-            Expr parse_or()
-            {
-                Expr lhs = parse_and();
-                while(*lex == '||')
-                {
+                    int op = *lex;
+                    auto power = binding_power(op);
+                    if(power.bind < min_power) { return lhs; } // not an operator (0) or binds looser than our caller.
                     ++lex;
-                    Expr rhs = parse_and();
-                    lhs = MathOp{'||', {std::move(lhs), std::move(rhs)}};
+                    Expr rhs = parse_binary(power.right ? power.bind : power.bind + 1);
+                    lhs = MathOp{op, {std::move(lhs), std::move(rhs)}};
                 }
-                return lhs;
             }
     };
 } // end my_parser namespace
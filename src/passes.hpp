@@ -0,0 +1,685 @@
+// passes.hpp
+
+#ifndef PASSES_HPP
+#define PASSES_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include "parser.hpp"
+
+namespace my_passes
+{
+    /*
+    CRTP walker over a function's AST. Dispatch to the hooks is static (no virtual calls, hooks that aren't
+    overridden inline away), Derived only defines the hooks it needs:
+
+        bool enter_stmt(Stmt&)    before a statement's children, false skips them.
+        void leave_stmt(Stmt&)    after its children; may replace the statement in place.
+        void leave_expr(Expr&)    after its children (post-order); may replace the expression in place.
+        void enter_block(Block&) / leave_block(Block&)
+    */
+    template<typename Derived>
+    struct Visitor
+    {
+        void walk(my_parser::Func& f) { walk(f.body); }
+
+        void walk(my_parser::Block& b)
+        {
+            self().enter_block(b);
+            for (auto& s : b.body) { walk(s); }
+            self().leave_block(b);
+        }
+
+        void walk(my_parser::Stmt& s)
+        {
+            if (!self().enter_stmt(s)) { return; }
+            s(
+                [&](my_parser::Block& b)  { walk(b); },
+                [&](my_parser::Loop& l)   { walk(l.body); },
+                [&](my_parser::If& i)     { walk(i.cond[0]); walk(i.body); if (i.else_body) { walk(*i.else_body); } },
+                [&](my_parser::Par& p)    { walk(p.lo); walk(p.hi); walk(p.body); },
+                [&](my_parser::Match& m)  { walk(m.value); for (auto& arm : m.arms) { walk(arm.body); } if (m.otherwise) { walk(*m.otherwise); } },
+                [&](my_parser::Let& let)  { walk(let.body); },
+                [&](my_parser::Assign& a) { walk(a.lhs); walk(a.rhs); },
+                [&](my_parser::Return& r) { walk(r.value); },
+                [&](my_parser::Expr& e)   { walk(e); },
+                [&](auto&) {}
+            );
+            self().leave_stmt(s);
+        }
+
+        void walk(my_parser::Expr& e)
+        {
+            e(
+                [&](my_parser::MathOp& op)   { for (auto& x : op.body)   { walk(x); } },
+                [&](my_parser::FnCall& call) { for (auto& x : call.args) { walk(x); } },
+                [&](my_parser::Array& arr)   { for (auto& x : arr.size)  { walk(x); } },
+                [&](auto&) {}
+            );
+            self().leave_expr(e);
+        }
+
+        // Default hooks.
+        bool enter_stmt(my_parser::Stmt&)   { return true; }
+        void leave_stmt(my_parser::Stmt&)   {}
+        void leave_expr(my_parser::Expr&)   {}
+        void enter_block(my_parser::Block&) {}
+        void leave_block(my_parser::Block&) {}
+
+        private:
+            Derived& self() { return static_cast<Derived&>(*this); }
+    };
+
+
+
+    // A rewriting pass: a Visitor with a name and a count of the rewrites it made. declare() sees the whole
+    // program before any function is run, when there is one (not when streaming).
+    template<typename Derived>
+    struct Pass : Visitor<Derived>
+    {
+        size_t changes = 0;
+        void declare(my_parser::Program&) {}
+        void run(my_parser::Func& f) { this->walk(f); }
+    };
+
+
+
+    // Folds operators whose operands are all literals, with the same i32 semantics as the generated code:
+    // + - * wrap around, comparisons and ! give 0/1, && and || short-circuit. Operations that trap or are undefined
+    // at run time (division by zero, INT_MIN / -1, shifts outside 0..31) are left alone.
+    struct ConstantFold : Pass<ConstantFold>
+    {
+        static constexpr const char *name = "constant-fold";
+
+        void leave_expr(my_parser::Expr& e)
+        {
+            auto *op = std::get_if<my_parser::MathOp>(&e);
+            if (!op) { return; }
+
+            auto literal = [](my_parser::Expr& x) { return std::get_if<my_parser::IntLiteral>(&x); };
+            auto *lhs = literal(op->body[0]);
+            auto *rhs = op->body.size() > 1 ? literal(op->body[1]) : nullptr;
+
+            // Short-circuit operators only need their left side.
+            if ((op->op == '&&' || op->op == '||') && lhs)
+            {
+                bool decided = op->op == '&&' ? !lhs->body : lhs->body;
+                if (decided) { replace(e, op->op == '||'); return; }
+                if (rhs)     { replace(e, rhs->body != 0); return; }
+                return;
+            }
+
+            if (!lhs || (op->body.size() > 1 && !rhs)) { return; }
+
+            auto value = op->body.size() == 1 ? unary(op->op, lhs->body) : binary(op->op, lhs->body, rhs->body);
+            if (value) { replace(e, *value); }
+        }
+
+        // The operators on i32 values, nullopt where the generated code would trap or be undefined.
+        // (&& and || are here without short-circuiting, both sides already known.)
+        static std::optional<my_lexer::i32> unary(int op, int64_t a)
+        {
+            switch (op)
+            {
+                case '+': { return (my_lexer::i32)a; } break;
+                case '-': { return wrap(-a); } break;
+                case '~': { return (my_lexer::i32)~a; } break;
+                case '!': { return a == 0; } break;
+                default:  { return std::nullopt; } break;
+            }
+        }
+
+        static std::optional<my_lexer::i32> binary(int op, int64_t a, int64_t b)
+        {
+            switch (op)
+            {
+                case '+':  { return wrap(a + b); } break;
+                case '-':  { return wrap(a - b); } break;
+                case '*':  { return wrap(a * b); } break;
+                case '/':  { if (b && !(a == INT32_MIN && b == -1)) { return (my_lexer::i32)(a / b); } } break;
+                case '%':  { if (b && !(a == INT32_MIN && b == -1)) { return (my_lexer::i32)(a % b); } } break;
+                case '<<': { if (b >= 0 && b < 32) { return wrap((int64_t)((uint64_t)(uint32_t)a << b)); } } break;
+                case '>>': { if (b >= 0 && b < 32) { return (my_lexer::i32)(a >> b); } } break;
+                case '&':  { return (my_lexer::i32)(a & b); } break;
+                case '|':  { return (my_lexer::i32)(a | b); } break;
+                case '^':  { return (my_lexer::i32)(a ^ b); } break;
+                case '<':  { return a < b;  } break;
+                case '>':  { return a > b;  } break;
+                case '<=': { return a <= b; } break;
+                case '>=': { return a >= b; } break;
+                case '==': { return a == b; } break;
+                case '!=': { return a != b; } break;
+                case '&&': { return a && b; } break;
+                case '||': { return a || b; } break;
+                default: break;
+            }
+            return std::nullopt;
+        }
+
+        private:
+            static my_lexer::i32 wrap(int64_t v) { return (my_lexer::i32)(uint32_t)(uint64_t)v; }
+
+            void replace(my_parser::Expr& e, int64_t value)
+            {
+                e = my_parser::IntLiteral{(my_lexer::i32)value};
+                ++changes;
+            }
+    };
+
+
+
+    // Removes statements that can never run: everything after a return/break/continue in the same block,
+    // the untaken side of an 'if' on a literal condition and the untaken arms of a 'match' on a literal.
+    struct DeadCode : Pass<DeadCode>
+    {
+        static constexpr const char *name = "dead-code";
+
+        void leave_stmt(my_parser::Stmt& s)
+        {
+            if (auto *match = std::get_if<my_parser::Match>(&s)) { return leave_match(s, *match); }
+
+            auto *stmt = std::get_if<my_parser::If>(&s);
+            if (!stmt) { return; }
+            auto *cond = std::get_if<my_parser::IntLiteral>(&stmt->cond[0]);
+            if (!cond) { return; }
+
+            ++changes;
+            if (cond->body)           { my_parser::Block taken = std::move(stmt->body);       s = std::move(taken); } // keeps its scope.
+            else if (stmt->else_body) { my_parser::Block taken = std::move(*stmt->else_body); s = std::move(taken); }
+            else                      { s = my_parser::Nop{}; }
+        }
+
+        void leave_match(my_parser::Stmt& s, my_parser::Match& match)
+        {
+            auto *value = std::get_if<my_parser::IntLiteral>(&match.value);
+            if (!value) { return; }
+
+            ++changes;
+            for (auto& arm : match.arms)
+            {
+                if (std::find(arm.labels.begin(), arm.labels.end(), value->body) == arm.labels.end()) { continue; }
+                my_parser::Block taken = std::move(arm.body);
+                s = std::move(taken);
+                return;
+            }
+            if (match.otherwise) { my_parser::Block taken = std::move(*match.otherwise); s = std::move(taken); }
+            else                 { s = my_parser::Nop{}; }
+        }
+
+        void leave_block(my_parser::Block& b)
+        {
+            for (size_t i = 0; i < b.body.size(); ++i)
+            {
+                bool jumps = std::holds_alternative<my_parser::Return>(b.body[i]) ||
+                             std::holds_alternative<my_parser::Break>(b.body[i])  ||
+                             std::holds_alternative<my_parser::Continue>(b.body[i]);
+                if (jumps && i + 1 < b.body.size())
+                {
+                    changes += b.body.size() - i - 1;
+                    b.body.resize(i + 1);
+                    return;
+                }
+            }
+        }
+    };
+
+
+
+    // Evaluates calls of const functions at compile time by walking their AST, with the generated code's i32
+    // semantics (ConstantFold's operators). It gives up (nullopt) on whatever it can't know or would trap at run
+    // time, and the call is left to run then: I/O, par, calls of functions that aren't const, names that aren't
+    // locals or scalar constants, out of bounds accesses, and more than max_steps statements, loop iterations and
+    // array elements touched, or max_depth nested calls. Locals start at 0.
+    struct Interpreter
+    {
+        static constexpr uint64_t max_steps = 1 << 22;
+        static constexpr size_t max_depth = 256;
+
+        Interpreter(my_lexer::Interner& ids) : ids(ids) {}
+
+        // A scalar, or an array (shared: array arguments are by reference).
+        struct Value { my_lexer::i32 scalar = 0; std::shared_ptr<std::vector<my_lexer::i32>> array; };
+
+        std::unordered_map<my_lexer::i32, my_parser::Func> functions; // the const functions, by name.
+        std::unordered_map<my_lexer::i32, my_lexer::i32> constants;   // scalar const globals.
+
+        std::optional<my_lexer::i32> call(my_parser::Func& f, std::vector<Value> args)
+        {
+            if (f.params.size() != args.size() || depth == max_depth) { return std::nullopt; }
+            if (depth == 0) { steps = 0; } // the limits are per call being folded.
+
+            std::vector<Scope> caller = std::move(scopes);
+            scopes.assign(1, {});
+            bool bound = true;
+            for (size_t i = 0; i < args.size(); ++i)
+            {
+                f.params[i](
+                    [&](my_parser::Variable& v) { bound &= !args[i].array; scopes[0][v.name] = std::move(args[i]); },
+                    [&](my_parser::Array& a)    { bound &= !!args[i].array; scopes[0][a.name] = std::move(args[i]); },
+                    [&](auto&) { bound = false; }
+                );
+            }
+
+            ++depth;
+            Flow flow = bound ? block(f.body) : FAIL;
+            --depth;
+            scopes = std::move(caller);
+
+            if (flow == RETURN) { return result; }
+            if (flow == NEXT)   { return 0; }      // fell off the end.
+            return std::nullopt;
+        }
+
+        private:
+            enum Flow { NEXT, BREAK, CONTINUE, RETURN, FAIL };
+            using Scope = std::unordered_map<my_lexer::i32, Value>;
+
+            std::vector<Scope> scopes;             // the current call's.
+            my_lexer::i32 result = 0;              // of the last RETURN.
+            uint64_t steps = 0;
+            size_t depth = 0;
+            my_lexer::Interner& ids;
+            const my_lexer::i32 len = ids["len"], fill = ids["fill"], copy = ids["copy"], equal = ids["equal"];
+
+            bool step(uint64_t n = 1) { steps += n; return steps <= max_steps; }
+
+            Value *lookup(my_lexer::i32 name)
+            {
+                for (size_t i = scopes.size() - 1; i != (size_t)-1; --i)
+                {
+                    auto found = scopes[i].find(name);
+                    if (found != scopes[i].end()) { return &found->second; }
+                }
+                return nullptr;
+            }
+
+            std::vector<my_lexer::i32> *array(my_lexer::i32 name) { Value *v = lookup(name); return v ? v->array.get() : nullptr; }
+
+            // The element a[index], null if out of bounds.
+            my_lexer::i32 *element(my_parser::Array& a)
+            {
+                auto *arr = array(a.name);
+                if (!arr) { return nullptr; }
+                auto index = eval(a.size[0]);
+                if (!index || *index < 0 || (size_t)*index >= arr->size()) { return nullptr; }
+                return &(*arr)[*index];
+            }
+
+            Flow block(my_parser::Block& b)
+            {
+                scopes.emplace_back();
+                Flow flow = NEXT;
+                for (auto& s : b.body) { if ((flow = stmt(s)) != NEXT) { break; } }
+                scopes.pop_back();
+                return flow;
+            }
+
+            Flow stmt(my_parser::Stmt& s)
+            {
+                if (!step()) { return FAIL; }
+                return s(
+                    [&](my_parser::Block& b) { return block(b); },
+                    [&](my_parser::Let& let) {
+                        return let.body(
+                            [&](my_parser::Variable& v) { scopes.back()[v.name] = {}; return NEXT; },
+                            [&](my_parser::Array& a) {
+                                auto n = eval(a.size[0]);
+                                if (!n || *n < 0 || !step(*n)) { return FAIL; }
+                                scopes.back()[a.name] = {0, std::make_shared<std::vector<my_lexer::i32>>(*n)};
+                                return NEXT;
+                            },
+                            [&](auto&) { return FAIL; }
+                        );
+                    },
+                    [&](my_parser::Assign& a) {
+                        auto value = eval(a.rhs);
+                        if (!value) { return FAIL; }
+                        return a.lhs(
+                            [&](my_parser::Variable& v) {
+                                Value *var = lookup(v.name);
+                                if (!var || var->array) { return FAIL; } // globals aren't ours to change.
+                                var->scalar = *value;
+                                return NEXT;
+                            },
+                            [&](my_parser::Array& arr) {
+                                my_lexer::i32 *e = element(arr);
+                                if (!e) { return FAIL; }
+                                *e = *value;
+                                return NEXT;
+                            },
+                            [&](auto&) { return FAIL; }
+                        );
+                    },
+                    [&](my_parser::Return& r) {
+                        auto value = eval(r.value);
+                        if (!value) { return FAIL; }
+                        result = *value;
+                        return RETURN;
+                    },
+                    [&](my_parser::Break&)    { return BREAK; },
+                    [&](my_parser::Continue&) { return CONTINUE; },
+                    [&](my_parser::Loop& l) {
+                        for (;;)
+                        {
+                            Flow flow = step() ? block(l.body) : FAIL;
+                            if (flow == BREAK) { return NEXT; }
+                            if (flow == RETURN || flow == FAIL) { return flow; }
+                        }
+                    },
+                    [&](my_parser::If& i) {
+                        auto cond = eval(i.cond[0]);
+                        if (!cond) { return FAIL; }
+                        if (*cond)       { return block(i.body); }
+                        if (i.else_body) { return block(*i.else_body); }
+                        return NEXT;
+                    },
+                    [&](my_parser::Match& m) {
+                        auto value = eval(m.value);
+                        if (!value) { return FAIL; }
+                        for (auto& arm : m.arms)
+                        {
+                            if (std::find(arm.labels.begin(), arm.labels.end(), *value) != arm.labels.end()) { return block(arm.body); }
+                        }
+                        return m.otherwise ? block(*m.otherwise) : NEXT;
+                    },
+                    [&](my_parser::Expr& e) { return eval(e) ? NEXT : FAIL; },
+                    [&](my_parser::Nop&)    { return NEXT; },
+                    [&](my_parser::Par&)    { return FAIL; }
+                );
+            }
+
+            std::optional<my_lexer::i32> eval(my_parser::Expr& e)
+            {
+                return e(
+                    [&](my_parser::IntLiteral& lit) -> std::optional<my_lexer::i32> { return lit.body; },
+                    [&](my_parser::Variable& v) -> std::optional<my_lexer::i32> {
+                        if (Value *var = lookup(v.name)) { if (var->array) { return std::nullopt; } return var->scalar; }
+                        auto found = constants.find(v.name);
+                        if (found == constants.end()) { return std::nullopt; }
+                        return found->second;
+                    },
+                    [&](my_parser::Array& a) -> std::optional<my_lexer::i32> {
+                        my_lexer::i32 *e = element(a);
+                        if (!e) { return std::nullopt; }
+                        return *e;
+                    },
+                    [&](my_parser::MathOp& op) -> std::optional<my_lexer::i32> {
+                        auto lhs = eval(op.body[0]);
+                        if (!lhs) { return std::nullopt; }
+                        if (op.body.size() == 1) { return ConstantFold::unary(op.op, *lhs); }
+                        if (op.op == '&&' && !*lhs) { return 0; } // short-circuit.
+                        if (op.op == '||' && *lhs)  { return 1; }
+                        auto rhs = eval(op.body[1]);
+                        if (!rhs) { return std::nullopt; }
+                        return ConstantFold::binary(op.op, *lhs, *rhs);
+                    },
+                    [&](my_parser::FnCall& c) { return fn_call(c); }
+                );
+            }
+
+            std::optional<my_lexer::i32> fn_call(my_parser::FnCall& c)
+            {
+                auto arg_array = [&](size_t i) -> std::vector<my_lexer::i32> * {
+                    auto *v = i < c.args.size() ? std::get_if<my_parser::Variable>(&c.args[i]) : nullptr;
+                    return v ? array(v->name) : nullptr;
+                };
+
+                if (c.name == len || c.name == fill || c.name == copy || c.name == equal) // len/fill/copy/equal, as in codegen.
+                {
+                    auto *a = arg_array(0);
+                    if (!a || c.args.size() != (c.name == len ? 1u : 2u)) { return std::nullopt; }
+                    if (c.name == len) { return (my_lexer::i32)a->size(); }
+                    if (!step(a->size())) { return std::nullopt; }
+                    if (c.name == fill)
+                    {
+                        auto value = eval(c.args[1]);
+                        if (!value) { return std::nullopt; }
+                        std::fill(a->begin(), a->end(), *value);
+                        return (my_lexer::i32)a->size();
+                    }
+                    auto *b = arg_array(1);
+                    if (!b) { return std::nullopt; }
+                    if (c.name == equal) { return *a == *b; }
+                    size_t n = std::min(a->size(), b->size());
+                    std::copy_n(b->begin(), n, a->begin());
+                    return (my_lexer::i32)n;
+                }
+
+                auto callee = functions.find(c.name); // write/putch/read aren't in here either.
+                if (callee == functions.end()) { return std::nullopt; }
+
+                std::vector<Value> args;
+                for (size_t i = 0; i < c.args.size(); ++i)
+                {
+                    auto *v = std::get_if<my_parser::Variable>(&c.args[i]);
+                    Value *var = v ? lookup(v->name) : nullptr;
+                    if (var && var->array) { args.push_back(*var); continue; } // by reference.
+                    auto value = eval(c.args[i]);
+                    if (!value) { return std::nullopt; }
+                    args.push_back({*value, nullptr});
+                }
+                return call(callee->second, std::move(args));
+            }
+    };
+
+
+
+    // Folds calls of const functions whose arguments are all literals to the value the call returns, evaluated by
+    // the Interpreter, then the operators around them like ConstantFold. A const function can't do I/O or 'par'.
+    // Streaming, only the const functions defined before a call can be evaluated.
+    struct ConstCalls : Pass<ConstCalls>
+    {
+        static constexpr const char *name = "const-calls";
+
+        ConstCalls(my_lexer::Interner& ids) : ids(ids), interp(ids) {}
+
+        void declare(my_parser::Program& p)
+        {
+            for (auto& g : p.globals)
+            {
+                if (!g.is_const || g.is_array) { continue; }
+                my_parser::Expr value = g.init.empty() ? my_parser::Expr{my_parser::IntLiteral{0}} : g.init[0];
+                fold.walk(value);
+                if (auto *lit = std::get_if<my_parser::IntLiteral>(&value)) { interp.constants[g.name] = lit->body; }
+            }
+            for (auto& f : p.body) { if (f.is_const) { define(f); } }
+        }
+
+        void run(my_parser::Func& f)
+        {
+            if (f.is_const) { define(f); } // before its body is walked, so it can be called recursively.
+            locals.assign(1, {});
+            for (auto& param : f.params) { name_of(param, [&](my_lexer::i32 name) { local(name); }); }
+            this->walk(f);
+            for (auto name : locals[0]) { --hidden[name]; }
+            if (f.is_const) { define(f); } // again, with its own calls folded.
+        }
+
+        // Track the locals that hide a constant, arguments naming the constant are literals everywhere else.
+        void enter_block(my_parser::Block&) { locals.emplace_back(); }
+        void leave_block(my_parser::Block&) { for (auto name : locals.back()) { --hidden[name]; } locals.pop_back(); }
+        bool enter_stmt(my_parser::Stmt& s)
+        {
+            if (auto *let = std::get_if<my_parser::Let>(&s)) { name_of(let->body, [&](my_lexer::i32 name) { local(name); }); }
+            if (auto *par = std::get_if<my_parser::Par>(&s)) // the index is a local of the body only.
+            {
+                this->walk(par->lo);
+                this->walk(par->hi);
+                locals.emplace_back();
+                local(par->index);
+                this->walk(par->body);
+                leave_block(par->body);
+                return false;
+            }
+            return true;
+        }
+
+        void leave_expr(my_parser::Expr& e)
+        {
+            if (auto *call = std::get_if<my_parser::FnCall>(&e))
+            {
+                auto callee = interp.functions.find(call->name);
+                if (callee == interp.functions.end()) { return; }
+                std::vector<Interpreter::Value> args;
+                for (auto& x : call->args)
+                {
+                    auto value = constant(x);
+                    if (!value) { return; }
+                    args.push_back({*value, nullptr});
+                }
+                auto value = interp.call(callee->second, std::move(args));
+                if (!value) { return; }
+                e = my_parser::IntLiteral{*value};
+                ++changes;
+                return;
+            }
+            fold.leave_expr(e); // operators whose operands just became literals.
+        }
+
+        private:
+            my_lexer::Interner& ids;
+            Interpreter interp;
+            ConstantFold fold;
+            std::vector<std::vector<my_lexer::i32>> locals;  // per block, the ones in 'hidden'.
+            std::unordered_map<my_lexer::i32, int> hidden;
+
+            template<typename F>
+            static void name_of(my_parser::Expr& e, F&& f)
+            {
+                e(
+                    [&](my_parser::Variable& v) { f(v.name); },
+                    [&](my_parser::Array& a)    { f(a.name); },
+                    [&](auto&) {}
+                );
+            }
+
+            void local(my_lexer::i32 name)
+            {
+                if (!interp.constants.contains(name)) { return; }
+                ++hidden[name];
+                locals.back().push_back(name);
+            }
+
+            std::optional<my_lexer::i32> constant(my_parser::Expr& e)
+            {
+                if (auto *lit = std::get_if<my_parser::IntLiteral>(&e)) { return lit->body; }
+                auto *v = std::get_if<my_parser::Variable>(&e);
+                if (!v || hidden[v->name]) { return std::nullopt; }
+                auto found = interp.constants.find(v->name);
+                if (found == interp.constants.end()) { return std::nullopt; }
+                return found->second;
+            }
+
+            void define(my_parser::Func& f)
+            {
+                struct Impure : Visitor<Impure>
+                {
+                    my_lexer::Interner& ids;
+                    const my_lexer::i32 write = ids["write"], putch = ids["putch"], read = ids["read"];
+                    std::string_view what;
+                    bool enter_stmt(my_parser::Stmt& s) { if (std::holds_alternative<my_parser::Par>(s)) { what = "par"; } return true; }
+                    void leave_expr(my_parser::Expr& e)
+                    {
+                        auto *call = std::get_if<my_parser::FnCall>(&e);
+                        if (call && (call->name == write || call->name == putch || call->name == read)) { what = ids[call->name]; }
+                    }
+                } impure{{}, ids};
+                impure.walk(f);
+                if (!impure.what.empty()) { ABORT("const function " << ids[f.name] << " can't use " << impure.what); }
+                interp.functions.insert_or_assign(f.name, f);
+            }
+    };
+
+
+
+    // Evaluates a module level initializer or array size whose names are already literals: the const function calls
+    // in it with the Interpreter (which has to know the const functions and scalar constants by then), and the
+    // operators around them. What can't be evaluated is left as it is.
+    struct ConstInit : Visitor<ConstInit>
+    {
+        Interpreter& interp;
+        ConstantFold fold;
+        ConstInit(Interpreter& interp) : interp(interp) {}
+
+        void leave_expr(my_parser::Expr& e)
+        {
+            auto *call = std::get_if<my_parser::FnCall>(&e);
+            if (!call) { fold.leave_expr(e); return; }
+            auto callee = interp.functions.find(call->name);
+            if (callee == interp.functions.end()) { return; }
+            std::vector<Interpreter::Value> args;
+            for (auto& x : call->args)
+            {
+                auto *lit = std::get_if<my_parser::IntLiteral>(&x);
+                if (!lit) { return; }
+                args.push_back({lit->body, nullptr});
+            }
+            if (auto value = interp.call(callee->second, std::move(args))) { e = my_parser::IntLiteral{*value}; }
+        }
+    };
+
+
+
+    // Runs Passes in order on every function handed to it, timing each pass and counting its rewrites. Passes that
+    // look names up are constructed with the interner of the parser that made the AST.
+    template<typename... Passes>
+    struct PassManager
+    {
+        PassManager(my_lexer::Interner& ids) : passes{make<Passes>(ids)...} {}
+
+        void declare(my_parser::Program& p) { std::apply([&](auto&... pass) { (pass.declare(p), ...); }, passes); }
+        void run(my_parser::Func& f) { run_each(f, std::index_sequence_for<Passes...>{}); }
+        void run(my_parser::Program& p) { declare(p); for (auto& f : p.body) { run(f); } }
+
+        void report(std::ostream& os)
+        {
+            os << "AST passes:\n";
+            report_each(os, std::index_sequence_for<Passes...>{});
+        }
+
+        private:
+            std::tuple<Passes...> passes;
+            std::chrono::steady_clock::duration time[sizeof...(Passes)] = {};
+
+            template<typename P>
+            static P make(my_lexer::Interner& ids)
+            {
+                if constexpr (std::is_constructible_v<P, my_lexer::Interner&>) { return P(ids); }
+                else { return P(); }
+            }
+
+
+            template<size_t... I>
+            void run_each(my_parser::Func& f, std::index_sequence<I...>)
+            {
+                ([&] {
+                    auto start = std::chrono::steady_clock::now();
+                    std::get<I>(passes).run(f);
+                    time[I] += std::chrono::steady_clock::now() - start;
+                }(), ...);
+            }
+
+            template<size_t... I>
+            void report_each(std::ostream& os, std::index_sequence<I...>)
+            {
+                ((os << "  " << std::tuple_element_t<I, std::tuple<Passes...>>::name << ": "
+                     << std::get<I>(passes).changes << " changes, "
+                     << std::chrono::duration<double, std::micro>(time[I]).count() << " us\n"), ...);
+            }
+    };
+
+    // The passes run before codegen, in this order.
+    using Pipeline = PassManager<ConstantFold, ConstCalls, DeadCode>;
+} // END my_passes namespace
+
+#endif
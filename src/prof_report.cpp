@@ -0,0 +1,64 @@
+// prof_report.cpp
+//
+// Prints the flat profile written by programs compiled with --profile (see runtime.cpp), hottest first.
+//
+//     ./prof_report [prof.out]
+//
+// Functions are sorted by self time (cycles spent in the function itself, not in its callees),
+// loops (--profile-loops) by trip count.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Fn   { unsigned long long calls, cycles, self; std::string name; };
+struct Loop { unsigned long long trips; std::string name; int index; };
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "prof.out";
+    FILE *in = fopen(path, "r");
+    if (!in) { fprintf(stderr, "can't read %s\n", path); return 1; }
+
+    std::vector<Fn> fns;
+    std::vector<Loop> loops;
+    unsigned long long total_self = 0;
+    char kind[8], name[4096];
+    while (fscanf(in, "%7s", kind) == 1)
+    {
+        if (!strcmp(kind, "fn"))
+        {
+            Fn f;
+            if (fscanf(in, "%llu %llu %llu %4095s", &f.calls, &f.cycles, &f.self, name) != 4) { break; }
+            f.name = name;
+            total_self += f.self;
+            fns.push_back(f);
+        }
+        else if (!strcmp(kind, "loop"))
+        {
+            Loop l;
+            if (fscanf(in, "%llu %4095s %d", &l.trips, name, &l.index) != 3) { break; }
+            l.name = name;
+            loops.push_back(l);
+        }
+        else { fprintf(stderr, "%s: unknown record '%s'\n", path, kind); return 1; }
+    }
+    fclose(in);
+
+    std::sort(fns.begin(), fns.end(), [](const Fn& a, const Fn& b) { return a.self > b.self; });
+    std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.trips > b.trips; });
+
+    printf("%7s %16s %16s %12s %14s  %s\n", "self%", "self cycles", "total cycles", "calls", "cycles/call", "function");
+    for (const Fn& f : fns)
+    {
+        double share = total_self ? 100.0 * f.self / total_self : 0;
+        printf("%6.2f%% %16llu %16llu %12llu %14llu  %s\n", share, f.self, f.cycles, f.calls, f.calls ? f.cycles / f.calls : 0, f.name.c_str());
+    }
+
+    if (loops.empty()) { return 0; }
+    printf("\n%16s  %s\n", "trips", "loop");
+    for (const Loop& l : loops) { printf("%16llu  %s, loop %d\n", l.trips, l.name.c_str(), l.index); }
+    return 0;
+}
@@ -0,0 +1,69 @@
+// queue.hpp
+
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace my_tools
+{
+    // Bounded single-producer/single-consumer queue, lock free.
+    // head/tail only ever grow; a slot is 'index & (Capacity - 1)'. Each side keeps a cached copy of the other side's
+    // index so it only touches the shared cache line when the queue looks full (producer) or empty (consumer).
+    template<typename T, size_t Capacity>
+    struct SpscQueue
+    {
+        static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+        SpscQueue() : slots(Capacity) {}
+
+        // Producer side. Only moves from v on success.
+        bool try_push(T& v)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head_cache == Capacity)
+            {
+                head_cache = head.load(std::memory_order_acquire);
+                if (t - head_cache == Capacity) { return false; } // full.
+            }
+            slots[t & (Capacity - 1)] = std::move(v);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        void push(T v) { while (!try_push(v)) { std::this_thread::yield(); } }
+
+        // Consumer side.
+        bool try_pop(T& out)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail_cache)
+            {
+                tail_cache = tail.load(std::memory_order_acquire);
+                if (h == tail_cache) { return false; } // empty.
+            }
+            out = std::move(slots[h & (Capacity - 1)]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        T pop()
+        {
+            T out;
+            while (!try_pop(out)) { std::this_thread::yield(); }
+            return out;
+        }
+
+        private:
+            std::vector<T> slots;
+            alignas(64) std::atomic<size_t> head{0}; // next slot to pop, written by the consumer.
+            size_t tail_cache = 0;                   // consumer's view of tail.
+            alignas(64) std::atomic<size_t> tail{0}; // next slot to push, written by the producer.
+            size_t head_cache = 0;                   // producer's view of head.
+    };
+} // END my_tools namespace
+
+#endif
@@ -0,0 +1,159 @@
+// report.hpp
+
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LLVMRemarkStreamer.h"
+#include "llvm/Remarks/RemarkStreamer.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lexer.hpp"
+
+namespace llvm
+{
+    // Size of a function's IR.
+    struct IRStats
+    {
+        size_t instructions = 0, blocks = 0, allocas = 0;
+
+        static IRStats of(const Function& f)
+        {
+            IRStats stats;
+            for (const BasicBlock& bb : f)
+            {
+                ++stats.blocks;
+                for (const Instruction& inst : bb) { ++stats.instructions; stats.allocas += isa<AllocaInst>(inst); }
+            }
+            return stats;
+        }
+    };
+
+
+    // Report mode (--report): per function, the size of the IR codegen produced and what is left after optimization,
+    // and the optimization remarks (passed/missed/analysis) LLVM emitted for it. The remarks themselves go to a YAML
+    // file, each tagged with its function, which is the source function's name ("<f>.parK" for par bodies of f).
+    struct Report
+    {
+        struct Entry
+        {
+            IRStats generated, optimized;
+            bool has_optimized = false; // split mode drops bodies before the end.
+            size_t passed = 0, missed = 0, analysis = 0;
+        };
+        std::map<std::string, Entry> functions; // by name, so par bodies come right after their function.
+
+        // A 'loop' with hints, and what the unroller and vectorizer said about it. Remarks only carry lines with -g,
+        // without it every remark of the function is matched.
+        struct Hint
+        {
+            std::string function;
+            unsigned line;
+            std::string text;
+            bool wants_unroll, wants_vectorize;
+            bool unrolled = false, vectorized = false;
+            std::vector<std::string> notes; // missed remarks and failed transformations.
+        };
+        std::vector<Hint> hints;
+
+        void hint(std::string function, unsigned line, std::string text, bool wants_unroll, bool wants_vectorize)
+        {
+            hints.push_back({std::move(function), line, std::move(text), wants_unroll, wants_vectorize});
+        }
+
+        // Stream every remark made in ctx to path and count them per function.
+        void attach(LLVMContext& ctx, const std::string& path)
+        {
+            auto file = setupLLVMOptimizationRemarks(ctx, path, "", "yaml", false);
+            if (!file) { ABORT("can't write remarks to " << path << ": " << toString(file.takeError())); }
+            remarks = std::move(*file);
+            ctx.setDiagnosticHandler(std::make_unique<Counter>(*this));
+        }
+
+        // Flush and close the remarks file; nothing is recorded after this.
+        void detach(LLVMContext& ctx)
+        {
+            ctx.setLLVMRemarkStreamer(nullptr);
+            ctx.setMainRemarkStreamer(nullptr);
+            ctx.setDiagnosticHandler(std::make_unique<DiagnosticHandler>());
+            remarks->keep();
+            remarks.reset();
+        }
+
+        void print(raw_ostream& os)
+        {
+            os << "                                            generated             optimized                  remarks\n"
+                  "function                      insts   blocks  allocas      insts     blocks   passed   missed analysis\n";
+            for (auto& [name, e] : functions)
+            {
+                os << format("%-24s %10zu %8zu %8zu ", name.c_str(), e.generated.instructions, e.generated.blocks, e.generated.allocas);
+                if (e.has_optimized) { os << format("%10zu %10zu ", e.optimized.instructions, e.optimized.blocks); }
+                else                 { os << "         -          - "; }
+                os << format("%8zu %8zu %8zu\n", e.passed, e.missed, e.analysis);
+            }
+            if (hints.empty()) { return; }
+
+            auto done = [](bool wanted, bool did) { return !wanted ? "-" : did ? "yes" : "NO"; };
+            os << "\nloop hints                                                     unrolled vectorized\n";
+            for (auto& h : hints)
+            {
+                std::string where = h.function + ":" + std::to_string(h.line);
+                os << format("%-24s %-37s %8s %10s\n", where.c_str(), h.text.c_str(), done(h.wants_unroll, h.unrolled), done(h.wants_vectorize, h.vectorized));
+                for (auto& note : h.notes) { os << "    " << note << "\n"; }
+            }
+        }
+
+        private:
+            std::unique_ptr<ToolOutputFile> remarks;
+
+            struct Counter : DiagnosticHandler
+            {
+                Report& report;
+                Counter(Report& report) : report(report) {}
+
+                bool handleDiagnostics(const DiagnosticInfo& di) override
+                {
+                    auto *remark = dyn_cast<DiagnosticInfoIROptimization>(&di);
+                    if (!remark) { return isa<DiagnosticInfoOptimizationBase>(di); } // machine remarks only go to the file.
+
+                    auto found = report.functions.find(remark->getFunction().getName().str());
+                    if (found == report.functions.end()) { return true; } // eg. the internal write/putch/read helpers.
+                    Entry& e = found->second;
+                    if      (isa<OptimizationRemark>(remark))         { ++e.passed; }
+                    else if (isa<OptimizationRemarkMissed>(remark))   { ++e.missed; }
+                    else    { ++e.analysis; }
+                    loop_hint(*remark);
+                    return true;
+                }
+
+                void loop_hint(const DiagnosticInfoIROptimization& remark)
+                {
+                    StringRef pass = remark.getPassName();
+                    if (pass != "loop-unroll" && pass != "loop-vectorize" && pass != "transform-warning") { return; }
+
+                    unsigned line = remark.isLocationAvailable() ? remark.getLocation().getLine() : 0;
+                    for (Hint& h : report.hints)
+                    {
+                        if (h.function != remark.getFunction().getName() || (line && h.line && line != h.line)) { continue; }
+                        if (isa<OptimizationRemark>(remark))
+                        {
+                            h.unrolled   |= pass == "loop-unroll";
+                            h.vectorized |= pass == "loop-vectorize";
+                        }
+                        else if (!isa<OptimizationRemarkAnalysis>(remark)) { h.notes.push_back(pass.str() + ": " + remark.getMsg()); }
+                    }
+                }
+            };
+    };
+} // end - llvm namespace
+
+#endif
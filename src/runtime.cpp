@@ -0,0 +1,340 @@
+// runtime.cpp
+//
+// Support code linked into programs generated by the compiler (see the Makefile):
+//     clang++ main.bc runtime.cpp -o main.elf
+// Everything the generated IR calls is extern "C" and prefixed with '__'.
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace my_runtime
+{
+    using i32 = int32_t;
+    using Chunk = i32 (*)(void *ctx, i32 lo, i32 hi); // outlined par body, runs [lo, hi) and returns its partial reduction.
+
+    // Reduction op codes, see Compiler::par_op_code() in codegen.hpp.
+    static i32 identity(i32 op)
+    {
+        switch(op)
+        {
+            case 2:  { return 1; } break;
+            case 3:  { return -1; } break;
+            case 6:  { return INT32_MAX; } break;
+            case 7:  { return INT32_MIN; } break;
+            default: { return 0; } break;
+        }
+    }
+
+    // Same wrap-around semantics as the generated i32 arithmetic.
+    static i32 combine(i32 op, i32 lhs, i32 rhs)
+    {
+        switch(op)
+        {
+            case 1:  { return (i32)((uint32_t)lhs + (uint32_t)rhs); } break;
+            case 2:  { return (i32)((uint32_t)lhs * (uint32_t)rhs); } break;
+            case 3:  { return lhs & rhs; } break;
+            case 4:  { return lhs | rhs; } break;
+            case 5:  { return lhs ^ rhs; } break;
+            case 6:  { return lhs < rhs ? lhs : rhs; } break;
+            case 7:  { return lhs > rhs ? lhs : rhs; } break;
+            default: { return 0; } break;
+        }
+    }
+
+    // One call to __par_for.
+    struct Job
+    {
+        Chunk body;
+        void *ctx;
+        i32 op;
+        std::atomic<i32> result;
+        std::atomic<int64_t> pending; // chunks not finished yet.
+    };
+
+    struct Task { Job *job; i32 lo, hi; };
+
+    // A worker's double-ended queue: the owner pushes/pops at the back (LIFO, cache warm),
+    // thieves take from the front (the oldest, usually biggest remaining work).
+    struct Deque
+    {
+        std::mutex m;
+        std::deque<Task> tasks;
+
+        void push(Task t) { std::lock_guard lock(m); tasks.push_back(t); }
+
+        bool pop(Task& t)
+        {
+            std::lock_guard lock(m);
+            if(tasks.empty()) { return false; }
+            t = tasks.back(); tasks.pop_back();
+            return true;
+        }
+
+        bool steal(Task& t)
+        {
+            std::lock_guard lock(m);
+            if(tasks.empty()) { return false; }
+            t = tasks.front(); tasks.pop_front();
+            return true;
+        }
+    };
+
+    struct Pool
+    {
+        // Threads: PAR_THREADS from the environment, otherwise one per core.
+        // Slot 0 belongs to threads outside the pool (ie., main), slots 1..n to the workers.
+        Pool()
+        {
+            size_t n = std::thread::hardware_concurrency();
+            if(const char *env = std::getenv("PAR_THREADS")) { n = std::strtoul(env, nullptr, 10); }
+            if(n < 1) { n = 1; }
+
+            for(size_t i = 0; i < n; ++i) { deques.push_back(std::make_unique<Deque>()); }
+            for(size_t i = 1; i < n; ++i) { workers.emplace_back([this, i] { self = i; work(); }); }
+        }
+
+        ~Pool()
+        {
+            { std::lock_guard lock(sleep_m); stop = true; }
+            sleep_cv.notify_all();
+            for(auto& t : workers) { t.join(); }
+        }
+
+        i32 run(Chunk body, void *ctx, i32 lo, i32 hi, i32 op)
+        {
+            if(lo >= hi) { return identity(op); }
+
+            // Roughly 8 chunks per thread so stealing can even out imbalanced iterations.
+            int64_t n     = (int64_t)hi - lo;
+            int64_t grain = n / (int64_t)(deques.size() * 8);
+            if(grain < 1) { grain = 1; }
+
+            Job job{body, ctx, op, identity(op), (n + grain - 1) / grain};
+            Deque& mine = *deques[self];
+            for(int64_t start = lo; start < hi; start += grain)
+            {
+                mine.push({&job, (i32)start, (i32)(start + grain < hi ? start + grain : hi)});
+            }
+            queued.fetch_add(job.pending.load(), std::memory_order_release);
+            { std::lock_guard lock(sleep_m); } // a worker between its predicate check and its wait would miss the notify.
+            sleep_cv.notify_all();
+
+            // Help until our job is done (this also runs other jobs' chunks, which keeps nested pars deadlock free).
+            while(job.pending.load(std::memory_order_acquire) > 0)
+            {
+                if(!run_one()) { std::this_thread::yield(); }
+            }
+            return job.result.load();
+        }
+
+        private:
+            std::vector<std::unique_ptr<Deque>> deques;
+            std::vector<std::thread> workers;
+            std::atomic<int64_t> queued{0}; // tasks sitting in any deque.
+            std::mutex sleep_m;
+            std::condition_variable sleep_cv;
+            bool stop = false;
+
+            static thread_local size_t self;
+
+            bool run_one()
+            {
+                Task t;
+                bool found = deques[self]->pop(t);
+                for(size_t i = 1; !found && i < deques.size(); ++i) { found = deques[(self + i) % deques.size()]->steal(t); }
+                if(!found) { return false; }
+                queued.fetch_sub(1, std::memory_order_relaxed);
+
+                Job& job = *t.job;
+                i32 partial = job.body(job.ctx, t.lo, t.hi);
+                if(job.op)
+                {
+                    i32 old = job.result.load(std::memory_order_relaxed);
+                    while(!job.result.compare_exchange_weak(old, combine(job.op, old, partial))) {}
+                }
+                job.pending.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+
+            void work()
+            {
+                while(true)
+                {
+                    if(run_one()) { continue; }
+                    std::unique_lock lock(sleep_m);
+                    sleep_cv.wait(lock, [&] { return stop || queued.load(std::memory_order_acquire) > 0; });
+                    if(stop) { return; }
+                }
+            }
+    };
+
+    thread_local size_t Pool::self = 0;
+
+    static Pool& pool()
+    {
+        static Pool p; // started on first use, so programs without par never spawn threads.
+        return p;
+    }
+
+
+
+    // Bump allocator backing arrays whose size is only known at run time.
+    // A function takes a mark on entry and releases back to it on return, which frees everything it (and its callees)
+    // allocated at once. Blocks are never handed back to malloc, so a warmed up arena allocates nothing.
+    // One per thread, so par chunks never contend.
+    struct Arena
+    {
+        static constexpr size_t block_size = 1 << 20;
+        static constexpr int    block_bits = 40; // mark = block index << block_bits | offset into the block.
+
+        void *alloc(int64_t bytes)
+        {
+            if(bytes < 0) { std::fprintf(stderr, "ABORT: array with negative size %lld\n", (long long)(bytes / 4)); std::abort(); }
+            bytes = (bytes + 15) & ~(int64_t)15;
+
+            while(blocks.empty() || top + bytes > blocks[cur].size)
+            {
+                if(!blocks.empty() && cur + 1 < blocks.size()) { ++cur; top = 0; continue; } // reuse (skipping too small blocks).
+
+                size_t size = (size_t)bytes > block_size ? (size_t)bytes : block_size;
+                char *data  = (char *)std::malloc(size);
+                if(!data) { std::fprintf(stderr, "ABORT: out of memory allocating %lld bytes\n", (long long)bytes); std::abort(); }
+                blocks.push_back({data, size});
+                cur = blocks.size() - 1;
+                top = 0;
+            }
+
+            void *res = blocks[cur].data + top;
+            top += bytes;
+            return res;
+        }
+
+        int64_t mark() { return (int64_t)((uint64_t)cur << block_bits | top); }
+
+        void release(int64_t mark)
+        {
+            cur = (size_t)((uint64_t)mark >> block_bits);
+            top = (size_t)((uint64_t)mark & (((uint64_t)1 << block_bits) - 1));
+        }
+
+        ~Arena() { for(auto& b : blocks) { std::free(b.data); } }
+
+        private:
+            struct Block { char *data; size_t size; };
+            std::vector<Block> blocks;
+            size_t cur = 0; // block being bumped.
+            size_t top = 0; // offset of the first free byte in it.
+    };
+
+    static thread_local Arena arena;
+
+
+
+    // Profiling (programs compiled with --profile): every function gets a record, see Compiler::prof_begin().
+    // Entry/exit hooks keep a shadow stack per thread so each frame's time can be split into its own (self) time
+    // and its callees'. Cycles are counted with rdtsc. Counters are shared by all threads (par chunks call functions too).
+    struct ProfRecord
+    {
+        const char *name;
+        uint64_t calls, cycles, self; // cycles include callees (and count recursive frames once per frame).
+        i32 loops;
+        uint64_t *trips;              // 'loops' loop trip counters (--profile-loops), in source order.
+    };
+
+    static inline uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    struct Profile
+    {
+        std::mutex m;
+        std::vector<ProfRecord *> records;
+
+        // Flat profile, one line per function and per loop (PROF_OUT from the environment, otherwise prof.out):
+        //     fn <calls> <cycles> <self cycles> <name>
+        //     loop <trips> <name> <n>              n-th loop of the function.
+        ~Profile()
+        {
+            const char *path = std::getenv("PROF_OUT");
+            FILE *out = std::fopen(path ? path : "prof.out", "w");
+            if(!out) { std::perror("prof.out"); return; }
+
+            for(ProfRecord *r : records)
+            {
+                std::fprintf(out, "fn %llu %llu %llu %s\n", (unsigned long long)r->calls, (unsigned long long)r->cycles, (unsigned long long)r->self, r->name);
+            }
+            for(ProfRecord *r : records)
+            {
+                for(i32 i = 0; i < r->loops; ++i) { std::fprintf(out, "loop %llu %s %d\n", (unsigned long long)r->trips[i], r->name, i); }
+            }
+            std::fclose(out);
+        }
+    };
+
+    static Profile& profile()
+    {
+        static Profile p; // constructed by the first __prof_register, so it's written after main returns.
+        return p;
+    }
+
+    struct Frame { uint64_t start, callees; };
+    static thread_local std::vector<Frame> frames;
+} // END my_runtime namespace
+
+extern "C"
+{
+    int32_t __par_for(my_runtime::Chunk body, void *ctx, int32_t lo, int32_t hi, int32_t op)
+    {
+        return my_runtime::pool().run(body, ctx, lo, hi, op);
+    }
+
+    void *__arena_alloc(int64_t bytes)     { return my_runtime::arena.alloc(bytes); }
+    int64_t __arena_mark()                 { return my_runtime::arena.mark(); }
+    void __arena_release(int64_t mark)     { my_runtime::arena.release(mark); }
+
+    // Called for every record from the generated __prof_init constructor.
+    void __prof_register(my_runtime::ProfRecord *r)
+    {
+        my_runtime::Profile& p = my_runtime::profile();
+        std::lock_guard lock(p.m);
+        p.records.push_back(r);
+    }
+
+    void __prof_enter(my_runtime::ProfRecord *)
+    {
+        my_runtime::frames.push_back({my_runtime::now(), 0});
+    }
+
+    void __prof_exit(my_runtime::ProfRecord *r)
+    {
+        using my_runtime::frames;
+        uint64_t total = my_runtime::now() - frames.back().start;
+        uint64_t self  = total - frames.back().callees;
+        frames.pop_back();
+        if(!frames.empty()) { frames.back().callees += total; }
+
+        __atomic_fetch_add(&r->calls, 1, __ATOMIC_RELAXED); // the records are plain globals in the generated code.
+        __atomic_fetch_add(&r->cycles, total, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&r->self, self, __ATOMIC_RELAXED);
+    }
+}
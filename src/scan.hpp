@@ -0,0 +1,188 @@
+// scan.hpp
+
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <cstdint>
+#include <cstring>
+#include "lexer.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Vectorized kernels for the lexer's long runs: whitespace, identifier/digit runs and comment bodies.
+//
+// All vector loads are aligned, so they never cross a page boundary and can safely look at bytes past the
+// null terminator (or before the start of the text); bytes before the scan position are masked off.
+// The null terminator is in none of the classes, so every scan stops at it.
+// The widest kernels the CPU supports are picked once at startup, with scalar LUT versions as the fallback.
+namespace my_lexer::scan
+{
+    struct Kernels
+    {
+        u8 *(*skip_ws)(u8 *, size_t& line); // first non-whitespace byte, counting the newlines skipped.
+        u8 *(*id_end)(u8 *);                // first byte that can't continue an identifier.
+        u8 *(*digits_end)(u8 *);            // first non-digit.
+        u8 *(*newline)(u8 *);               // first '\n' or null terminator.
+    };
+
+
+
+    // ------------------------------------------------------------------------------------ scalar
+
+    static u8 *skip_ws_scalar(u8 *p, size_t& line)
+    {
+        static constexpr LUT is_ws(" \n\t\r\v\f");
+        while(is_ws(*p)) { line += *p == '\n'; ++p; }
+        return p;
+    }
+
+    static u8 *id_end_scalar(u8 *p)
+    {
+        static constexpr LUT still_id("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789");
+        while(still_id(*p)) { ++p; }
+        return p;
+    }
+
+    static u8 *digits_end_scalar(u8 *p)
+    {
+        static constexpr LUT is_digit("0123456789");
+        while(is_digit(*p)) { ++p; }
+        return p;
+    }
+
+    static u8 *newline_scalar(u8 *p)
+    {
+        static constexpr LUT is_new_line("\n", true);
+        while(!is_new_line(*p)) { ++p; }
+        return p;
+    }
+
+
+
+#ifdef SCAN_X86
+    // ------------------------------------------------------------------------------------ vector
+    //
+    // scan_kernels.hpp is written once against a vector type V (load, set, bits, eq, either, in_range) and
+    // included once per width. The AVX2 copy is compiled for AVX2 as a whole, so its intrinsics inline.
+
+    namespace sse2
+    {
+        struct V
+        {
+            static constexpr size_t width = 16;
+            using vec = __m128i;
+
+            // Inlined into the kernels, which are exempt from ASan: the aligned loads read around the text on purpose.
+            __attribute__((always_inline, no_sanitize_address)) static vec load(const u8 *p) { return _mm_load_si128((const vec *)p); }
+            static vec set(u8 c)            { return _mm_set1_epi8((char)c); }
+            static uint32_t bits(vec v)     { return (uint32_t)_mm_movemask_epi8(v); }
+            static vec eq(vec a, vec b)     { return _mm_cmpeq_epi8(a, b); }
+            static vec either(vec a, vec b) { return _mm_or_si128(a, b); }
+            static vec in_range(vec v, u8 lo, u8 hi) // lo <= v <= hi, unsigned.
+            {
+                vec d = _mm_sub_epi8(v, set(lo));
+                return _mm_cmpeq_epi8(_mm_min_epu8(d, set(hi - lo)), d);
+            }
+        };
+        #include "scan_kernels.hpp"
+    }
+
+#if defined(__clang__)
+    #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+#endif
+    namespace avx2
+    {
+        struct V
+        {
+            static constexpr size_t width = 32;
+            using vec = __m256i;
+
+            __attribute__((always_inline, no_sanitize_address)) static vec load(const u8 *p) { return _mm256_load_si256((const vec *)p); }
+            static vec set(u8 c)            { return _mm256_set1_epi8((char)c); }
+            static uint32_t bits(vec v)     { return (uint32_t)_mm256_movemask_epi8(v); }
+            static vec eq(vec a, vec b)     { return _mm256_cmpeq_epi8(a, b); }
+            static vec either(vec a, vec b) { return _mm256_or_si256(a, b); }
+            static vec in_range(vec v, u8 lo, u8 hi)
+            {
+                vec d = _mm256_sub_epi8(v, set(lo));
+                return _mm256_cmpeq_epi8(_mm256_min_epu8(d, set(hi - lo)), d);
+            }
+        };
+        #include "scan_kernels.hpp"
+    }
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+#endif
+
+
+
+    static Kernels pick()
+    {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) { return {avx2::skip_ws, avx2::id_end, avx2::digits_end, avx2::newline}; }
+        return {sse2::skip_ws, sse2::id_end, sse2::digits_end, sse2::newline}; // SSE2 is baseline on x86-64.
+#else
+        return {skip_ws_scalar, id_end_scalar, digits_end_scalar, newline_scalar};
+#endif
+    }
+
+    static const Kernels kernels = pick();
+
+
+
+    // ------------------------------------------------------------------------------------ integers
+
+    // Eight ASCII digits (first digit in the lowest byte) to their value, with three multiplies.
+    static inline uint64_t swar_8_digits(uint64_t chars)
+    {
+        uint64_t v = chars - 0x3030303030303030ull;
+        v = (v * 10) + (v >> 8);
+        v = ((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) + (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)));
+        return v >> 32;
+    }
+
+    // Value of the digit run [start, end). Returns false if it does not fit an i32.
+    __attribute__((no_sanitize_address)) static inline bool parse_int(const u8 *start, const u8 *end, i32& value)
+    {
+        while(start != end && *start == '0') { ++start; } // leading zeros don't count towards the length.
+        size_t len = end - start;
+        if(len > 10) { return false; }
+
+        uint64_t v = 0;
+        if(len > 8)
+        {
+            for(; len > 8; --len) { v = v * 10 + (*start++ - '0'); }
+            uint64_t chars;
+            std::memcpy(&chars, start, 8);
+            v = v * 100000000 + swar_8_digits(chars);
+        }
+        else if(len && ((uintptr_t)start & 4095) <= 4096 - 8) // 8 byte load stays in the page: pad with leading zeros.
+        {
+            uint64_t chars;
+            std::memcpy(&chars, start, 8);
+            uint64_t shift = (8 - len) * 8;
+            chars = shift ? (chars << shift) | (0x3030303030303030ull >> (64 - shift)) : chars;
+            v = swar_8_digits(chars);
+        }
+        else
+        {
+            for(; start != end; ++start) { v = v * 10 + (*start - '0'); }
+        }
+
+        if(v > INT32_MAX) { return false; }
+        value = (i32)v;
+        return true;
+    }
+} // end my_lexer::scan namespace
+
+#endif
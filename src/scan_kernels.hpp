@@ -0,0 +1,53 @@
+// scan_kernels.hpp
+//
+// No include guard: scan.hpp includes this once per vector width, inside a namespace that defines V.
+// See scan.hpp for what the kernels do.
+
+// Per-byte classes, all-ones in the bytes that belong to the class.
+static inline V::vec ws(V::vec v)        { return V::either(V::eq(v, V::set(' ')), V::in_range(v, '\t', '\r')); } // \t \n \v \f \r
+static inline V::vec nl(V::vec v)        { return V::eq(v, V::set('\n')); }
+static inline V::vec digit(V::vec v)     { return V::in_range(v, '0', '9'); }
+static inline V::vec nl_or_end(V::vec v) { return V::either(nl(v), V::eq(v, V::set(0))); }
+static inline V::vec id(V::vec v)
+{
+    V::vec lower = V::either(v, V::set(0x20)); // 'A'..'Z' -> 'a'..'z'
+    return V::either(V::either(V::in_range(lower, 'a', 'z'), digit(v)), V::eq(v, V::set('_')));
+}
+
+static constexpr uint32_t all = V::width < 32 ? (1u << V::width) - 1 : 0xffffffff;
+
+// First byte from p whose class bit is 'want'; the first (aligned) block has the bytes before p masked off.
+template<V::vec (*Class)(V::vec), bool want>
+__attribute__((no_sanitize_address)) static inline u8 *find(u8 *p)
+{
+    u8 *block = (u8 *)((uintptr_t)p & ~(uintptr_t)(V::width - 1));
+    uint32_t m = V::bits(Class(V::load(block)));
+    m = (want ? m : ~m) & all & (uint32_t)((uint64_t)0xffffffff << (p - block));
+    while(!m)
+    {
+        block += V::width;
+        m = V::bits(Class(V::load(block)));
+        m = (want ? m : ~m) & all;
+    }
+    return block + __builtin_ctz(m);
+}
+
+__attribute__((no_sanitize_address)) static u8 *skip_ws(u8 *p, size_t& line)
+{
+    u8 *block = (u8 *)((uintptr_t)p & ~(uintptr_t)(V::width - 1));
+    uint32_t valid = all & (uint32_t)((uint64_t)0xffffffff << (p - block));
+    while(true)
+    {
+        V::vec v = V::load(block);
+        uint32_t stop = ~V::bits(ws(v)) & valid;                // first non-whitespace ends the run.
+        uint32_t upto = stop ? (stop & -stop) - 1 : valid;      // bytes of this block that are part of the run.
+        line += __builtin_popcount(V::bits(nl(v)) & valid & upto);
+        if(stop) { return block + __builtin_ctz(stop); }
+        block += V::width;
+        valid = all;
+    }
+}
+
+static u8 *id_end(u8 *p)     { return find<id, false>(p); }
+static u8 *digits_end(u8 *p) { return find<digit, false>(p); }
+static u8 *newline(u8 *p)    { return find<nl_or_end, true>(p); }
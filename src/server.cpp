@@ -0,0 +1,190 @@
+// server.cpp
+//
+// Compile server: keeps LLVM initialized between compiles instead of paying process startup for every script.
+//
+//     ./complierd [socket]        (default /tmp/complier.sock)
+//
+// Protocol (one request per connection, see client.cpp):
+//     request:  "obj\n" | "bc\n" | "ll\n", then one compiler option per line and an empty line, then the source;
+//               the client shuts down its write side at the end.
+//               Options: -O<n>, -g, --no-ast-opt, --stack-limit <bytes>, --profile, --profile-loops, --source <path>
+//               (the name debug info refers to), each argument on its own line like argv.
+//     response: 'O' followed by the object/bitcode/IR on success,
+//               anything else is the compiler's error output (eg. "ABORT: ...").
+//
+// Every connection is served by a fork() of the warmed up server: the target machine, registries and pages touched
+// by the warm-up compile are shared copy-on-write, requests run concurrently on all cores. The compile itself runs
+// in one more fork, with stderr going to a file: an ABORT only takes down that process, and whatever the compiler
+// printed is only sent back if it failed.
+
+#include <iostream>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "lexer.cpp"
+#include "tools.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/TargetSelect.h"
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+    while (size)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) { return false; }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// The whole of f, from the start.
+static std::vector<char> contents(FILE *f)
+{
+    std::vector<char> data;
+    rewind(f);
+    char buf[1 << 16];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) { data.insert(data.end(), buf, buf + n); }
+    return data;
+}
+
+// Options from the request's header lines, false (and why in error) for one the server doesn't take.
+static bool parse_options(const std::vector<std::string>& args, llvm::Options& opts, std::string& error)
+{
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        if      (arg.starts_with("-O"))                   { opts.opt_level = std::atoi(arg.c_str() + 2); }
+        else if (arg == "-g")                             { opts.debug_info = true; }
+        else if (arg == "--no-ast-opt")                   { opts.ast_passes = false; }
+        else if (arg == "--stack-limit" && has_value)     { opts.stack_limit = std::strtoull(args[++i].c_str(), nullptr, 10); }
+        else if (arg == "--profile")                      { opts.profile = true; }
+        else if (arg == "--profile-loops")                { opts.profile = opts.profile_loops = true; }
+        else if (arg == "--source" && has_value)          { opts.source = args[++i]; }
+        else    { error = "unsupported option " + arg + "\n"; return false; }
+    }
+    return true;
+}
+
+static void serve(int conn, llvm::TargetMachine& tm)
+{
+    // Read the whole request.
+    std::vector<my_lexer::u8> request;
+    char buf[1 << 16];
+    for (ssize_t n; (n = read(conn, buf, sizeof(buf))) > 0;) { request.insert(request.end(), buf, buf + n); }
+
+    // Header: the mode line, option lines, an empty line.
+    std::vector<std::string> header;
+    auto at = request.begin();
+    while (true)
+    {
+        auto newline = std::find(at, request.end(), '\n');
+        if (newline == request.end()) { write_all(conn, "bad request\n", 12); return; }
+        std::string line(at, newline);
+        at = newline + 1;
+        if (line.empty() && !header.empty()) { break; }
+        header.push_back(std::move(line));
+    }
+    std::string mode = header[0];
+    request.erase(request.begin(), at);
+    request.push_back(0); // the lexer stops at the null terminator.
+
+    llvm::Options opts;
+    opts.print_ir = false;
+    opts.output = "";
+    std::string error;
+    if (!parse_options({header.begin() + 1, header.end()}, opts, error)) { write_all(conn, error.data(), error.size()); return; }
+    if (mode != "obj" && mode != "bc" && mode != "ll") { error = "unknown mode " + mode + "\n"; write_all(conn, error.data(), error.size()); return; }
+
+    FILE *diagnostics = tmpfile(), *result = tmpfile();
+    if (!diagnostics || !result) { write_all(conn, "no temporary files\n", 19); return; }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(fileno(diagnostics), STDERR_FILENO);
+        llvm::SmallVector<char, 0> out;
+        llvm::raw_svector_ostream os(out);
+        {
+            my_lexer::Interner ids;
+            llvm::Compiler compiler{request.data(), ids, opts};
+            if      (mode == "obj") { compiler.emit_object(os, tm); }
+            else if (mode == "bc")  { compiler.emit_bitcode(os); }
+            else                    { compiler.emit_ir(os); }
+        }
+        bool written = fwrite(out.data(), 1, out.size(), result) == out.size() && fflush(result) == 0;
+        _exit(written ? 0 : 1);
+    }
+
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (ok)
+    {
+        std::vector<char> out = contents(result);
+        write_all(conn, "O", 1);
+        write_all(conn, out.data(), out.size());
+        return;
+    }
+    std::vector<char> messages = contents(diagnostics);
+    if (messages.empty()) { write_all(conn, "compile failed\n", 15); return; }
+    write_all(conn, messages.data(), messages.size());
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/complier.sock";
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    std::unique_ptr<llvm::TargetMachine> tm = llvm::host_target_machine();
+
+    // Warm up: one full compile so everything LLVM initializes lazily is done before the first fork.
+    {
+        static my_lexer::u8 warm_up[] = "main() { return 0; }";
+        llvm::SmallVector<char, 0> out;
+        llvm::raw_svector_ostream os(out);
+        my_lexer::Interner ids;
+        llvm::Compiler{warm_up, ids, {.print_ir = false, .output = ""}}.emit_object(os, *tm);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) { ABORT("socket: " << strerror(errno)); }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { ABORT("socket path too long: " << path); }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) < 0) { ABORT("bind " << path << ": " << strerror(errno)); }
+    if (listen(listener, 64) < 0) { ABORT("listen: " << strerror(errno)); }
+
+    signal(SIGCHLD, SIG_IGN); // children are reaped automatically.
+    std::cerr << "complierd listening on " << path << "\n";
+
+    while (true)
+    {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) { continue; }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL); // serve() waits for its compile.
+            serve(conn, *tm);
+            _exit(0); // skip the parent's static destructors.
+        }
+        if (pid < 0) { std::cerr << "fork: " << strerror(errno) << "\n"; }
+        close(conn);
+    }
+}
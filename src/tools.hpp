@@ -1,6 +1,9 @@
 #ifndef MYTOOLS_HPP
 #define MYTOOLS_HPP
 #include<string>
+#include<vector>
+#include<fstream>
+#include<iterator>
 
 namespace my_tools
 {
@@ -13,5 +16,15 @@ namespace my_tools
         }
         return s;
     }
+
+    // Whole file as bytes plus the null terminator the lexer stops at. Empty if it can't be read.
+    static std::vector<unsigned char> read_file(const char *path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if(!file) { return {}; }
+        std::vector<unsigned char> text{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        text.push_back(0);
+        return text;
+    }
 } // END my_tools namespace
 #endif
\ No newline at end of file
@@ -0,0 +1,797 @@
+// vm.hpp
+
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "passes.hpp"
+
+extern "C" // runtime.cpp: the interpreter allocates arrays from the same per-thread arena as compiled code.
+{
+    void *__arena_alloc(int64_t bytes);
+    int64_t __arena_mark();
+    void __arena_release(int64_t mark);
+}
+
+// Bytecode backend (--run): a Program is lowered to register-based bytecode and interpreted right away, without
+// paying for LLVM at all. Every function counts its calls and loop back-edges; once one gets hot, tier_up (jit.hpp)
+// compiles the whole program with LLVM and the following calls to it run native code. A call already running gets
+// there too: once a loop back-edge makes its function hot, the rest of the call is handed over, frame and all, to
+// the function's on-stack replacement entry (Jit::osr) at the loop head, so a hot loop in main doesn't keep
+// interpreting until main returns.
+//
+// Registers are i32s private to a call. Arrays live in slots, a (pointer, length) slice each, which is also how
+// they are passed to callees.
+namespace my_vm
+{
+    using my_lexer::i32;
+
+    // a, b, c operands; r[] are registers, s[] slots, 'target' an instruction index.
+    #define VM_OPS(X)                                                                                          \
+        X(LOADK)  /* r[a] = b                                     */                                        \
+        X(MOV)    /* r[a] = r[b]                                  */                                        \
+        X(ADD) X(SUB) X(MUL) X(DIV) X(REM) X(SHL) X(SHR) X(AND) X(OR) X(XOR) /* r[a] = r[b] op r[c]     */      \
+        X(LT) X(GT) X(LE) X(GE) X(EQ) X(NE)                                  /* r[a] = r[b] cmp r[c]    */      \
+        X(NEG) X(NOT) X(LNOT)                                                /* r[a] = op r[b]          */      \
+        X(JMP)    /* goto a                                       */                                        \
+        X(JZ) X(JNZ)                                                          /* if r[a] (!)= 0 goto b   */      \
+        X(JLT) X(JGT) X(JLE) X(JGE) X(JEQ) X(JNE)                            /* if r[a] cmp r[b] goto c */      \
+        X(LOOP)   /* back-edge: count it, goto a                  */                                        \
+        X(SWITCH) /* goto switches[b][r[a]]                       */                                        \
+        X(GLOAD)  /* r[a] = globals[b]                            */                                        \
+        X(GSTORE) /* globals[a] = r[b]                            */                                        \
+        X(GSLICE) /* s[a] = global array b                        */                                        \
+        X(ANEW)   /* s[a] = new array of r[b] elements            */                                        \
+        X(ALOAD)  /* r[a] = s[b][r[c]]                            */                                        \
+        X(ASTORE) /* s[a][r[b]] = r[c]                            */                                        \
+        X(LEN)    /* r[a] = len(s[b])                             */                                        \
+        X(FILL)   /* r[a] = fill(s[b], r[c])                      */                                        \
+        X(COPY)   /* r[a] = copy(s[b], s[c])                      */                                        \
+        X(EQUAL)  /* r[a] = equal(s[b], s[c])                     */                                        \
+        X(CALL)   /* r[a] = functions[b](r[c], r[c + 1], ...)     */                                        \
+        X(RET)    /* return r[a]                                  */                                        \
+        X(WRITE) X(PUTCH)                                                     /* r[a] = write(r[b])      */      \
+        X(READ)   /* r[a] = read()                                */
+
+    enum Op : uint8_t
+    {
+        #define X(op) op,
+        VM_OPS(X)
+        #undef X
+    };
+
+    struct Insn { Op op; i32 a, b, c; };
+
+    struct Slice { i32 *data; i32 len; };
+
+    using Entry = i32 (*)(const uint64_t *args); // a function's native code, see Jit::entry.
+    using Osr = i32 (*)(i32 *regs, Slice *slots, i32 pc); // the rest of a running call from loop head pc, see Jit::osr.
+
+    // Dense table when the labels are close together, sorted labels (binary search) otherwise.
+    struct Switch
+    {
+        i32 lo = 0, otherwise = 0;
+        std::vector<i32> dense;
+        std::vector<std::pair<i32, i32>> sparse; // (label, target)
+
+        i32 target(i32 value) const
+        {
+            if (!dense.empty())
+            {
+                uint32_t i = (uint32_t)value - (uint32_t)lo;
+                return i < dense.size() ? dense[i] : otherwise;
+            }
+            auto it = std::lower_bound(sparse.begin(), sparse.end(), std::pair<i32, i32>{value, INT32_MIN});
+            return it != sparse.end() && it->first == value ? it->second : otherwise;
+        }
+    };
+
+    struct Function
+    {
+        std::string name;
+        std::vector<bool> array_params;
+        std::vector<Insn> code;
+        std::vector<Switch> switches;
+        i32 regs = 0, slots = 0;                       // frame size.
+
+        uint64_t calls = 0, loops = 0;                 // hotness.
+        bool tiered = false, osr_tried = false;        // tier up / on-stack replacement was tried.
+        Entry native = nullptr;                        // once hot.
+        Osr osr = nullptr;                             // once a loop of a running call is hot.
+    };
+
+    struct Global
+    {
+        std::string name;
+        bool is_array, is_const;
+        std::unique_ptr<i32[]> data;                   // stable: compiled code reads and writes it too.
+        i32 len;
+    };
+
+    struct Program
+    {
+        std::vector<Function> functions;
+        std::vector<Global> globals;
+        std::unordered_map<std::string, size_t> by_name;
+        const char *unsupported = nullptr;             // set if the source uses something the VM can't run (eg. par).
+    };
+
+
+
+    // ------------------------------------------------------------------------------------ lowering
+
+    struct Lower
+    {
+        Program out;
+
+        Lower(my_parser::Program& prog, my_lexer::Interner& ids) : ids(ids), consts(ids) // the parser's, for the names in prog.
+        {
+            scopes.emplace_back(); // globals.
+            for (auto& f : prog.body) { if (f.is_const) { consts.functions.insert_or_assign(f.name, f); } } // globals may call them.
+            for (auto& g : prog.globals) { global(g); }
+            for (auto& f : prog.body)
+            {
+                std::string_view name = ids[f.name];
+                if (name == "len" || name == "fill" || name == "copy" || name == "equal") { ABORT("Function " << name << " takes the name of a builtin"); } // like codegen.
+                out.by_name[std::string(ids[f.name])] = out.functions.size();
+                out.functions.emplace_back();
+            }
+            for (size_t i = 0; i < prog.body.size(); ++i) { function(prog.body[i], out.functions[i]); }
+
+            // Calls were emitted before every callee had an index, resolve them by name now.
+            for (auto& [fn, pc, name, arrays] : calls)
+            {
+                auto found = out.by_name.find(std::string(ids[name]));
+                if (found == out.by_name.end()) { ABORT("Tried to call undeclared function " << ids[name]); }
+                Function& callee = out.functions[found->second];
+                Insn& call = out.functions[fn].code[pc];
+                if (arrays != callee.array_params) { ABORT("Wrong arguments calling " << callee.name); }
+                call.b = (i32)found->second;
+            }
+        }
+
+        private:
+            my_lexer::Interner& ids;
+            my_passes::Interpreter consts;                 // evaluates const function calls in globals.
+            struct Sym { enum Kind { REG, SLOT, GLOBAL } kind; i32 index; };
+            std::vector<std::unordered_map<i32, Sym>> scopes;
+
+            Function *fn = nullptr;
+            size_t fn_index = 0;
+            i32 top = 0, slot_top = 0;                     // register/slot stacks, reset at the end of each statement.
+            struct Loop { size_t head; std::vector<size_t> breaks; };
+            std::vector<Loop> loops;
+            std::vector<std::tuple<size_t, size_t, i32, std::vector<bool>>> calls; // (function, pc, callee name, which args are arrays)
+
+            size_t emit(Op op, i32 a = 0, i32 b = 0, i32 c = 0) { fn->code.push_back({op, a, b, c}); return fn->code.size() - 1; }
+            i32 here() const { return (i32)fn->code.size(); }
+            void patch(std::vector<size_t>& jumps, i32 target)
+            {
+                for (size_t pc : jumps)
+                {
+                    Insn& j = fn->code[pc];
+                    (j.op == JMP ? j.a : j.op == JZ || j.op == JNZ ? j.b : j.c) = target;
+                }
+                jumps.clear();
+            }
+
+            i32 reg()  { i32 r = top++;      fn->regs  = std::max(fn->regs, top);       return r; }
+            i32 slot() { i32 s = slot_top++; fn->slots = std::max(fn->slots, slot_top); return s; }
+
+            Sym lookup(i32 name)
+            {
+                for (size_t i = scopes.size() - 1; i != (size_t)-1; --i)
+                {
+                    auto found = scopes[i].find(name);
+                    if (found != scopes[i].end()) { return found->second; }
+                }
+                ABORT("Failed to find symbol " << ids[name]);
+            }
+
+            void unsupported(const char *what) { if (!out.unsupported) { out.unsupported = what; } }
+
+
+            void global(my_parser::Global& g)
+            {
+                auto value = [&](my_parser::Expr e) {
+                    struct Substitute : my_passes::Visitor<Substitute>
+                    {
+                        Lower& lower;
+                        Substitute(Lower& lower) : lower(lower) {}
+                        void leave_expr(my_parser::Expr& e)
+                        {
+                            auto *v = std::get_if<my_parser::Variable>(&e);
+                            if (!v) { return; }
+                            Sym sym = lower.lookup(v->name);
+                            Global& g = lower.out.globals[sym.index];
+                            if (!g.is_const || g.is_array) { ABORT(lower.ids[v->name] << " is not a constant"); }
+                            e = my_parser::IntLiteral{g.data[0]};
+                        }
+                    } substitute{*this};
+                    substitute.walk(e);
+                    my_passes::ConstInit{consts}.walk(e);
+                    auto *lit = std::get_if<my_parser::IntLiteral>(&e);
+                    if (!lit) { ABORT("Expected a constant expression"); }
+                    return lit->body;
+                };
+
+                Global out_g{std::string(ids[g.name]), g.is_array, g.is_const, nullptr, 1};
+                if (g.is_array) { out_g.len = g.size ? value(*g.size) : (i32)g.init.size(); }
+                if (out_g.len <= 0 || g.init.size() > (size_t)out_g.len) { ABORT("Bad size for " << out_g.name); }
+                out_g.data = std::make_unique<i32[]>(out_g.len); // zeroed.
+                for (size_t i = 0; i < g.init.size(); ++i) { out_g.data[i] = value(g.init[i]); }
+                if (g.is_const && !g.is_array) { consts.constants[g.name] = out_g.data[0]; } // for const functions.
+
+                scopes[0][g.name] = {Sym::GLOBAL, (i32)out.globals.size()};
+                out.globals.push_back(std::move(out_g));
+            }
+
+
+            void function(my_parser::Func& f, Function& out_fn)
+            {
+                fn = &out_fn;
+                fn_index = &out_fn - out.functions.data();
+                fn->name = std::string(ids[f.name]);
+                top = slot_top = 0;
+                fn->regs = fn->slots = 0;
+
+                scopes.emplace_back();
+                for (auto& param : f.params) // variables take registers 0.., arrays slots 0.., in order.
+                {
+                    param(
+                        [&](my_parser::Variable& v) { fn->array_params.push_back(false); scopes.back()[v.name] = {Sym::REG, reg()}; },
+                        [&](my_parser::Array& a)    { fn->array_params.push_back(true);  scopes.back()[a.name] = {Sym::SLOT, slot()}; },
+                        [&](auto&) { ABORT("Parser made an error with parameter types."); }
+                    );
+                }
+                for (auto& s : f.body.body) { stmt(s); }
+                scopes.pop_back();
+
+                i32 zero = reg(); // falling off the end returns 0.
+                emit(LOADK, zero, 0);
+                emit(RET, zero);
+            }
+
+
+            void block(my_parser::Block& b)
+            {
+                i32 saved_top = top, saved_slots = slot_top;
+                scopes.emplace_back();
+                for (auto& s : b.body) { stmt(s); }
+                scopes.pop_back();
+                top = saved_top;
+                slot_top = saved_slots;
+            }
+
+            void stmt(my_parser::Stmt& s)
+            {
+                i32 saved_top = top, saved_slots = slot_top; // temporaries die with the statement.
+                s(
+                    [&](my_parser::Block& b) { block(b); },
+                    [&](my_parser::Let& let) {
+                        let.body(
+                            [&](my_parser::Variable& v) { scopes.back()[v.name] = {Sym::REG, reg()}; saved_top = top; },
+                            [&](my_parser::Array& a) {
+                                i32 array = slot();
+                                saved_slots = slot_top;
+                                emit(ANEW, array, expr(a.size[0]));
+                                scopes.back()[a.name] = {Sym::SLOT, array};
+                            },
+                            [&](auto&) { ABORT("Let tried to declare non var or array"); }
+                        );
+                    },
+                    [&](my_parser::Assign& a) {
+                        a.lhs(
+                            [&](my_parser::Variable& v) {
+                                Sym sym = lookup(v.name);
+                                if (sym.kind == Sym::SLOT) { ABORT("Tried to assign to a variable as array"); }
+                                if (sym.kind == Sym::REG) { expr(a.rhs, sym.index); return; }
+                                Global& g = out.globals[sym.index];
+                                if (g.is_array) { ABORT("Tried to assign to a variable as array"); }
+                                if (g.is_const) { ABORT("Tried to assign to const " << g.name); }
+                                emit(GSTORE, sym.index, expr(a.rhs));
+                            },
+                            [&](my_parser::Array& arr) {
+                                i32 array = array_slot(arr.name, true);
+                                i32 index = expr(arr.size[0]);
+                                emit(ASTORE, array, index, expr(a.rhs));
+                            },
+                            [&](auto&) { ABORT("Assigning to non var or array?"); }
+                        );
+                    },
+                    [&](my_parser::Return& ret) { emit(RET, expr(ret.value)); },
+                    [&](my_parser::Break&) {
+                        if (loops.empty()) { ABORT("Break outside of a loop"); }
+                        loops.back().breaks.push_back(emit(JMP));
+                    },
+                    [&](my_parser::Continue&) {
+                        if (loops.empty()) { ABORT("Continue outside of a loop"); }
+                        emit(LOOP, (i32)loops.back().head);
+                    },
+                    [&](my_parser::Loop& l) {
+                        loops.push_back({fn->code.size(), {}});
+                        block(l.body);
+                        emit(LOOP, (i32)loops.back().head);
+                        patch(loops.back().breaks, here());
+                        loops.pop_back();
+                    },
+                    [&](my_parser::If& i) {
+                        std::vector<size_t> to_else;
+                        cond(i.cond[0], false, to_else);
+                        block(i.body);
+                        if (!i.else_body) { patch(to_else, here()); return; }
+                        std::vector<size_t> to_end{emit(JMP)};
+                        patch(to_else, here());
+                        block(*i.else_body);
+                        patch(to_end, here());
+                    },
+                    [&](my_parser::Match& m) {
+                        i32 value = expr(m.value);
+                        i32 index = (i32)fn->switches.size();
+                        fn->switches.emplace_back();
+                        emit(SWITCH, value, index);
+
+                        std::vector<size_t> to_end;
+                        std::vector<std::pair<i32, i32>> labels;
+                        for (auto& arm : m.arms)
+                        {
+                            for (i32 label : arm.labels) { labels.push_back({label, here()}); }
+                            block(arm.body);
+                            to_end.push_back(emit(JMP));
+                        }
+                        i32 otherwise = here();
+                        if (m.otherwise) { block(*m.otherwise); }
+                        patch(to_end, here());
+
+                        Switch& sw = fn->switches[index];
+                        sw.otherwise = otherwise;
+                        std::sort(labels.begin(), labels.end());
+                        int64_t range = labels.empty() ? 0 : (int64_t)labels.back().first - labels.front().first + 1;
+                        if (!labels.empty() && range <= 2 * (int64_t)labels.size() + 8)
+                        {
+                            sw.lo = labels.front().first;
+                            sw.dense.assign(range, otherwise);
+                            for (auto& [label, target] : labels) { sw.dense[(int64_t)label - sw.lo] = target; }
+                        }
+                        else { sw.sparse = std::move(labels); }
+                    },
+                    [&](my_parser::Par&) { unsupported("par"); },
+                    [&](my_parser::Nop&) {},
+                    [&](my_parser::Expr& e) { expr(e); }
+                );
+                top = saved_top;
+                slot_top = saved_slots;
+            }
+
+
+            // Slot of the named array; global arrays are bound to a temporary slot.
+            i32 array_slot(i32 name, bool for_write = false)
+            {
+                Sym sym = lookup(name);
+                if (sym.kind == Sym::SLOT) { return sym.index; }
+                if (sym.kind == Sym::REG || !out.globals[sym.index].is_array) { ABORT(ids[name] << " is not an array"); }
+                if (for_write && out.globals[sym.index].is_const) { ABORT("Tried to assign to const " << ids[name]); }
+                i32 s = slot();
+                emit(GSLICE, s, sym.index);
+                return s;
+            }
+
+            bool names_array(my_parser::Expr& e)
+            {
+                auto *v = std::get_if<my_parser::Variable>(&e);
+                if (!v) { return false; }
+                Sym sym = lookup(v->name);
+                return sym.kind == Sym::SLOT || (sym.kind == Sym::GLOBAL && out.globals[sym.index].is_array);
+            }
+
+            static Op compare(int op)
+            {
+                switch (op)
+                {
+                    case '<':  { return JLT; } break;
+                    case '>':  { return JGT; } break;
+                    case '<=': { return JLE; } break;
+                    case '>=': { return JGE; } break;
+                    case '==': { return JEQ; } break;
+                    case '!=': { return JNE; } break;
+                    default:   { return JMP; } break; // not a comparison.
+                }
+            }
+
+            static Op negate(Op j)
+            {
+                switch (j)
+                {
+                    case JLT: { return JGE; } break;
+                    case JGE: { return JLT; } break;
+                    case JGT: { return JLE; } break;
+                    case JLE: { return JGT; } break;
+                    case JEQ: { return JNE; } break;
+                    default:  { return JEQ; } break;
+                }
+            }
+
+            // Jumps (added to 'jumps', patched by the caller) when e is jump_if, falls through otherwise.
+            // Comparisons become one compare-and-branch, && / || / ! only rearrange the jumps.
+            void cond(my_parser::Expr& e, bool jump_if, std::vector<size_t>& jumps)
+            {
+                if (auto *lit = std::get_if<my_parser::IntLiteral>(&e))
+                {
+                    if ((lit->body != 0) == jump_if) { jumps.push_back(emit(JMP)); }
+                    return;
+                }
+
+                auto *op = std::get_if<my_parser::MathOp>(&e);
+                if (op && (op->op == '&&' || op->op == '||'))
+                {
+                    bool decides = op->op == '||'; // the lhs value that decides the whole thing.
+                    if (decides == jump_if)
+                    {
+                        cond(op->body[0], jump_if, jumps);
+                        cond(op->body[1], jump_if, jumps);
+                        return;
+                    }
+                    std::vector<size_t> skip;
+                    cond(op->body[0], decides, skip);
+                    cond(op->body[1], jump_if, jumps);
+                    patch(skip, here());
+                    return;
+                }
+                if (op && op->op == '!' && op->body.size() == 1) { cond(op->body[0], !jump_if, jumps); return; }
+                if (op && op->body.size() == 2 && compare(op->op) != JMP)
+                {
+                    i32 saved = top;
+                    i32 lhs = expr(op->body[0]);
+                    i32 rhs = expr(op->body[1]);
+                    top = saved;
+                    Op j = compare(op->op);
+                    jumps.push_back(emit(jump_if ? j : negate(j), lhs, rhs));
+                    return;
+                }
+
+                i32 saved = top;
+                i32 value = expr(e);
+                top = saved;
+                jumps.push_back(emit(jump_if ? JNZ : JZ, value));
+            }
+
+            // Register holding e's value: dst if given, otherwise a variable's own register or a temporary.
+            i32 expr(my_parser::Expr& e, i32 dst = -1)
+            {
+                auto target = [&] { return dst >= 0 ? dst : reg(); };
+                return e(
+                    [&](my_parser::IntLiteral& lit) { i32 r = target(); emit(LOADK, r, lit.body); return r; },
+                    [&](my_parser::Variable& v) {
+                        Sym sym = lookup(v.name);
+                        if (sym.kind == Sym::REG)
+                        {
+                            if (dst >= 0 && dst != sym.index) { emit(MOV, dst, sym.index); return dst; }
+                            return sym.index;
+                        }
+                        if (sym.kind == Sym::SLOT || out.globals[sym.index].is_array) { ABORT("Array " << ids[v.name] << " used as a value"); }
+                        Global& g = out.globals[sym.index];
+                        i32 r = target();
+                        if (g.is_const) { emit(LOADK, r, g.data[0]); } // constant propagated.
+                        else            { emit(GLOAD, r, sym.index); }
+                        return r;
+                    },
+                    [&](my_parser::Array& a) {
+                        i32 array = array_slot(a.name);
+                        i32 index = expr(a.size[0]);
+                        i32 r = target();
+                        emit(ALOAD, r, array, index);
+                        return r;
+                    },
+                    [&](my_parser::FnCall& call) { return fn_call(call, target); },
+                    [&](my_parser::MathOp& op) {
+                        if (op.op == '&&' || op.op == '||' || compare(op.op) != JMP || op.op == '!')
+                        {
+                            // Booleans: branch, then materialize 0/1 once.
+                            std::vector<size_t> to_false;
+                            cond(e, false, to_false);
+                            i32 r = target();
+                            emit(LOADK, r, 1);
+                            std::vector<size_t> to_end{emit(JMP)};
+                            patch(to_false, here());
+                            emit(LOADK, r, 0);
+                            patch(to_end, here());
+                            return r;
+                        }
+
+                        i32 saved = top;
+                        i32 lhs = expr(op.body[0]);
+                        if (op.body.size() == 1)
+                        {
+                            top = saved;
+                            i32 r = target();
+                            switch (op.op)
+                            {
+                                case '+': { if (r != lhs) { emit(MOV, r, lhs); } } break;
+                                case '-': { emit(NEG, r, lhs); } break;
+                                case '~': { emit(NOT, r, lhs); } break;
+                                default:  { ABORT("unhandled MathOp? " << my_tools::token_to_string(op.op)); } break;
+                            }
+                            return r;
+                        }
+                        i32 rhs = expr(op.body[1]);
+                        top = saved;
+                        i32 r = target();
+                        Op code;
+                        switch (op.op)
+                        {
+                            case '+':  { code = ADD; } break;
+                            case '-':  { code = SUB; } break;
+                            case '*':  { code = MUL; } break;
+                            case '/':  { code = DIV; } break;
+                            case '%':  { code = REM; } break;
+                            case '<<': { code = SHL; } break;
+                            case '>>': { code = SHR; } break;
+                            case '&':  { code = AND; } break;
+                            case '|':  { code = OR;  } break;
+                            case '^':  { code = XOR; } break;
+                            default:   { ABORT("unhandled MathOp? " << my_tools::token_to_string(op.op)); } break;
+                        }
+                        emit(code, r, lhs, rhs);
+                        return r;
+                    },
+                    [&](auto&) -> i32 { ABORT("unhandled expression?"); }
+                );
+            }
+
+            template<typename Target>
+            i32 fn_call(my_parser::FnCall& call, Target&& target)
+            {
+                std::string_view name = ids[call.name];
+                auto arity = [&](size_t n) { if (call.args.size() != n) { ABORT(name << " takes " << n << " arguments"); } };
+
+                if (name == "write" || name == "putch") { arity(1); i32 v = expr(call.args[0]); i32 r = target(); emit(name == "write" ? WRITE : PUTCH, r, v); return r; }
+                if (name == "read") { arity(0); i32 r = target(); emit(READ, r); return r; }
+                if (name == "len" || name == "fill" || name == "copy" || name == "equal")
+                {
+                    arity(name == "len" ? 1 : 2);
+                    auto array = [&](my_parser::Expr& e, bool for_write) {
+                        auto *v = std::get_if<my_parser::Variable>(&e);
+                        if (!v) { ABORT("Expected an array"); }
+                        return array_slot(v->name, for_write);
+                    };
+                    i32 a = array(call.args[0], name == "fill" || name == "copy");
+                    if (name == "len") { i32 r = target(); emit(LEN, r, a); return r; }
+                    if (name == "fill") { i32 v = expr(call.args[1]); i32 r = target(); emit(FILL, r, a, v); return r; }
+                    i32 b = array(call.args[1], false);
+                    i32 r = target();
+                    emit(name == "copy" ? COPY : EQUAL, r, a, b);
+                    return r;
+                }
+
+                // Arguments go to consecutive registers; arrays pass their slot number.
+                i32 base = top;
+                for (size_t i = 0; i < call.args.size(); ++i) { reg(); }
+                std::vector<bool> arrays;
+                for (size_t i = 0; i < call.args.size(); ++i)
+                {
+                    bool is_array = names_array(call.args[i]);
+                    arrays.push_back(is_array);
+                    if (is_array)
+                    {
+                        i32 array = std::get<my_parser::Variable>(call.args[i]).name;
+                        Sym sym = lookup(array);
+                        if (sym.kind == Sym::GLOBAL && out.globals[sym.index].is_const) { ABORT("Can't pass const array " << ids[array] << " to " << name); } // like codegen.
+                        emit(LOADK, base + (i32)i, array_slot(array));
+                    }
+                    else          { expr(call.args[i], base + (i32)i); }
+                }
+                i32 r = target();
+                size_t pc = emit(CALL, r, -1, base);
+                calls.push_back({fn_index, pc, call.name, std::move(arrays)});
+                return r;
+            }
+    };
+
+
+
+    // ------------------------------------------------------------------------------------ interpreter
+
+    struct Vm
+    {
+        // Native code of a function by name, null if there is none: entry (Jit::entry) for calls, osr (Jit::osr)
+        // for a call running a hot loop.
+        struct TierUp
+        {
+            std::function<Entry (const std::string&)> entry;
+            std::function<Osr (const std::string&)> osr;
+            explicit operator bool() const { return (bool)entry; }
+        };
+
+        Vm(Program& prog, uint64_t call_threshold, uint64_t loop_threshold, TierUp tier_up)
+            : prog(prog), call_threshold(call_threshold), loop_threshold(loop_threshold), tier_up(std::move(tier_up)),
+              regs(new i32[max_regs]), slots(new Slice[max_slots]), reg_top(regs.get()), slot_top(slots.get())
+        {}
+
+        i32 run()
+        {
+            auto found = prog.by_name.find("main");
+            if (found == prog.by_name.end()) { ABORT("No main()"); }
+            return call(prog.functions[found->second], nullptr, nullptr);
+        }
+
+        i32 call(Function& f, const i32 *args, const Slice *caller_slots)
+        {
+            ++f.calls;
+            if (!f.native && !f.tiered && tier_up && (f.calls >= call_threshold || f.loops >= loop_threshold))
+            {
+                f.tiered = true;
+                f.native = tier_up.entry(f.name);
+            }
+            if (f.native)
+            {
+                uint64_t argv[64];
+                size_t n = 0;
+                for (size_t i = 0; i < f.array_params.size(); ++i)
+                {
+                    if (n + 2 > std::size(argv)) { ABORT("Too many arguments calling " << f.name); }
+                    if (!f.array_params[i]) { argv[n++] = (uint32_t)args[i]; continue; }
+                    const Slice& s = caller_slots[args[i]];
+                    argv[n++] = (uint64_t)(uintptr_t)s.data;
+                    argv[n++] = (uint32_t)s.len;
+                }
+                return f.native(argv);
+            }
+
+            if (reg_top + f.regs > regs.get() + max_regs || slot_top + f.slots > slots.get() + max_slots) { ABORT("VM stack overflow in " << f.name); }
+            i32 *r = reg_top;
+            Slice *s = slot_top;
+            reg_top += f.regs;
+            slot_top += f.slots;
+
+            i32 nregs = 0, nslots = 0;
+            for (size_t i = 0; i < f.array_params.size(); ++i)
+            {
+                if (f.array_params[i]) { s[nslots++] = caller_slots[args[i]]; }
+                else                   { r[nregs++] = args[i]; }
+            }
+
+            int64_t mark = __arena_mark();
+            i32 result = execute(f, r, s);
+            __arena_release(mark);
+
+            reg_top = r;
+            slot_top = s;
+            return result;
+        }
+
+        private:
+            static constexpr size_t max_regs = 1 << 22, max_slots = 1 << 20;
+
+            Program& prog;
+            uint64_t call_threshold, loop_threshold;
+            TierUp tier_up;
+            std::unique_ptr<i32[]> regs;
+            std::unique_ptr<Slice[]> slots;
+            i32 *reg_top;
+            Slice *slot_top;
+
+            // Called on a hot back-edge of f: tiers f up for its next calls and returns where to finish this one.
+            Osr on_stack_replace(Function& f)
+            {
+                if (!f.tiered) { f.tiered = true; f.native = tier_up.entry(f.name); }
+                if (!f.osr_tried) { f.osr_tried = true; f.osr = tier_up.osr(f.name); }
+                return f.osr;
+            }
+
+            // Computed goto: every handler jumps straight to the next one, so each opcode's dispatch is its own
+            // (well predicted) indirect branch instead of one shared switch.
+            i32 execute(Function& f, i32 *r, Slice *s)
+            {
+                static const void *handlers[] = {
+                    #define X(op) &&op_##op,
+                    VM_OPS(X)
+                    #undef X
+                };
+                const Insn *code = f.code.data();
+                const Insn *ip = code;
+
+                #define NEXT()   do { ++ip; goto *handlers[ip->op]; } while (0)
+                #define JUMP(to) do { ip = code + (to); goto *handlers[ip->op]; } while (0)
+                #define BINARY(op, expr) op_##op: { uint32_t x = (uint32_t)r[ip->b], y = (uint32_t)r[ip->c]; (void)x; (void)y; r[ip->a] = (i32)(expr); NEXT(); }
+                #define BRANCH(op, cmp)  op_##op: { if (r[ip->a] cmp r[ip->b]) { JUMP(ip->c); } NEXT(); }
+
+                goto *handlers[ip->op];
+
+                op_LOADK: { r[ip->a] = ip->b; NEXT(); }
+                op_MOV:   { r[ip->a] = r[ip->b]; NEXT(); }
+                BINARY(ADD, x + y)
+                BINARY(SUB, x - y)
+                BINARY(MUL, x * y)
+                op_DIV:   { r[ip->a] = r[ip->b] / r[ip->c]; NEXT(); } // traps like the native sdiv.
+                op_REM:   { r[ip->a] = r[ip->b] % r[ip->c]; NEXT(); }
+                BINARY(SHL, x << (y & 31))
+                op_SHR:   { r[ip->a] = r[ip->b] >> (r[ip->c] & 31); NEXT(); }
+                BINARY(AND, x & y)
+                BINARY(OR,  x | y)
+                BINARY(XOR, x ^ y)
+                op_LT:    { r[ip->a] = r[ip->b] <  r[ip->c]; NEXT(); }
+                op_GT:    { r[ip->a] = r[ip->b] >  r[ip->c]; NEXT(); }
+                op_LE:    { r[ip->a] = r[ip->b] <= r[ip->c]; NEXT(); }
+                op_GE:    { r[ip->a] = r[ip->b] >= r[ip->c]; NEXT(); }
+                op_EQ:    { r[ip->a] = r[ip->b] == r[ip->c]; NEXT(); }
+                op_NE:    { r[ip->a] = r[ip->b] != r[ip->c]; NEXT(); }
+                op_NEG:   { r[ip->a] = (i32)(0u - (uint32_t)r[ip->b]); NEXT(); }
+                op_NOT:   { r[ip->a] = ~r[ip->b]; NEXT(); }
+                op_LNOT:  { r[ip->a] = !r[ip->b]; NEXT(); }
+                op_JMP:   { JUMP(ip->a); }
+                op_JZ:    { if (!r[ip->a]) { JUMP(ip->b); } NEXT(); }
+                op_JNZ:   { if (r[ip->a])  { JUMP(ip->b); } NEXT(); }
+                BRANCH(JLT, <)
+                BRANCH(JGT, >)
+                BRANCH(JLE, <=)
+                BRANCH(JGE, >=)
+                BRANCH(JEQ, ==)
+                BRANCH(JNE, !=)
+                op_LOOP:
+                {
+                    if (++f.loops >= loop_threshold && tier_up)
+                    {
+                        if (Osr osr = on_stack_replace(f)) { return osr(r, s, ip->a); } // the frame is dropped by call().
+                    }
+                    JUMP(ip->a);
+                }
+                op_SWITCH:{ JUMP(f.switches[ip->b].target(r[ip->a])); }
+                op_GLOAD: { r[ip->a] = prog.globals[ip->b].data[0]; NEXT(); }
+                op_GSTORE:{ prog.globals[ip->a].data[0] = r[ip->b]; NEXT(); }
+                op_GSLICE:{ s[ip->a] = {prog.globals[ip->b].data.get(), prog.globals[ip->b].len}; NEXT(); }
+                op_ANEW:
+                {
+                    i32 len = r[ip->b];
+                    s[ip->a] = {(i32 *)__arena_alloc((int64_t)len * sizeof(i32)), len};
+                    NEXT();
+                }
+                op_ALOAD: { r[ip->a] = s[ip->b].data[r[ip->c]]; NEXT(); }
+                op_ASTORE:{ s[ip->a].data[r[ip->b]] = r[ip->c]; NEXT(); }
+                op_LEN:   { r[ip->a] = s[ip->b].len; NEXT(); }
+                op_FILL:
+                {
+                    Slice& a = s[ip->b];
+                    std::fill(a.data, a.data + a.len, r[ip->c]);
+                    r[ip->a] = a.len;
+                    NEXT();
+                }
+                op_COPY:
+                {
+                    Slice& a = s[ip->b];
+                    Slice& b = s[ip->c];
+                    i32 n = (uint32_t)a.len < (uint32_t)b.len ? a.len : b.len;
+                    std::memmove(a.data, b.data, (size_t)n * sizeof(i32));
+                    r[ip->a] = n;
+                    NEXT();
+                }
+                op_EQUAL:
+                {
+                    Slice& a = s[ip->b];
+                    Slice& b = s[ip->c];
+                    r[ip->a] = a.len == b.len && !std::memcmp(a.data, b.data, (size_t)a.len * sizeof(i32));
+                    NEXT();
+                }
+                op_CALL:  { r[ip->a] = call(prog.functions[ip->b], r + ip->c, s); NEXT(); }
+                op_RET:   { return r[ip->a]; }
+                op_WRITE: { std::printf("%d", r[ip->b]); r[ip->a] = 0; NEXT(); }
+                op_PUTCH: { std::printf("%c", r[ip->b]); r[ip->a] = 0; NEXT(); }
+                op_READ:  { i32 v = 0; if (std::scanf("%d", &v) != 1) { v = 0; } r[ip->a] = v; NEXT(); }
+
+                #undef NEXT
+                #undef JUMP
+                #undef BINARY
+                #undef BRANCH
+            }
+    };
+} // END my_vm namespace
+
+#endif
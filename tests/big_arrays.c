@@ -0,0 +1,31 @@
+// Arrays too big for the stack frame (over --stack-limit, 16K by default) live in the thread's arena instead,
+// one per call, so recursion and lets inside loops work without raising the stack limit.
+// should print 4000000 45 then 500500.
+depth(n) {
+   let big[1000000];
+   big[999999] = n;
+   if n == 0 { return 0; }
+   let below;
+   below = depth(n - 1);
+   return below + big[999999];
+}
+
+main() {
+   let total;
+   total = 0;
+   let i;
+   i = 0;
+   loop {
+       if i == 1000 { break; }
+       let scratch[100000];
+       scratch[i] = i + 1;
+       total = total + scratch[i];
+       i = i + 1;
+   }
+
+   let huge[1000000];
+   write(len(huge) * 4); putch(32);
+   write(depth(9)); putch(10);
+   write(total); putch(10);
+   return 0;
+}
@@ -0,0 +1,69 @@
+// const functions: calls with constant arguments are evaluated at compile time (see --pass-stats), the others at run time.
+// should print 17711 25 55 7 then 6765 then 1004 (a par index hides the constant N) and
+// 144 6 (globals sized and initialized by const calls).
+const N = 10;
+
+const fib(n) {
+   if n < 2 { return n; }
+   return fib(n - 1) + fib(n - 2);
+}
+
+const F = fib(12);
+
+const sum(a[0]) {
+   let total;
+   total = 0;
+   let i;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       total = total + a[i];
+       i = i + 1;
+   }
+   return total;
+}
+
+const triangle(n) {
+   let a[n + 1];
+   let i;
+   i = 0;
+   loop {
+       if i > n { break; }
+       a[i] = i;
+       i = i + 1;
+   }
+   return sum(a);
+}
+
+let table[triangle(3)];
+
+const collatz(n) {
+   let steps;
+   steps = 0;
+   loop {
+       if n == 1 { break; }
+       match n % 2 {
+           0 => { n = n / 2; }
+           _ => { n = 3 * n + 1; }
+       }
+       steps = steps + 1;
+   }
+   return steps;
+}
+
+main() {
+   write(fib(22)); putch(32);
+   write(fib(5) * (fib(6) - 3)); putch(32);
+   write(triangle(N)); putch(32);
+   write(collatz(3)); putch(32);
+   let n;
+   n = 20;
+   write(fib(n)); putch(10);
+   let total;
+   total = 0;
+   par N = 0, 4 reduce + total { total = total + triangle(N) * 100 + fib(N); }
+   write(total); putch(32);
+   write(F); putch(32);
+   write(len(table));
+   return 0;
+}
@@ -0,0 +1,50 @@
+// Arrays sized at run time live in the arena and are freed when their function returns.
+// should print 4950, 4950 and then 200000.
+sum_to(n) {
+   let a[n];
+   let i;
+   i = 0;
+   loop {
+       if i == n { break; }
+       a[i] = i;
+       i = i + 1;
+   }
+
+   let total;
+   total = 0;
+   i = 0;
+   loop {
+       if i == n { break; }
+       total = total + a[i];
+       i = i + 1;
+   }
+   return total;
+}
+
+main() {
+   write(sum_to(100));
+   putch(10);
+   write(sum_to(50 + 50));
+   putch(10);
+
+   // far too big for the stack, and allocated over and over.
+   let big;
+   big = 0;
+   let rounds;
+   rounds = 0;
+   loop {
+       if rounds == 100 { break; }
+       big = sum_to(2000) / 1999000 * 2000 + big;
+       rounds = rounds + 1;
+   }
+   write(big);
+   putch(10);
+
+   let n;
+   n = 4000000;
+   let huge[n];
+   huge[n - 1] = 7;
+   par i = 0, 4 { let scratch[n / 4]; scratch[0] = i; }
+
+   return huge[n - 1] - 7;
+}
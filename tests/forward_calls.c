@@ -0,0 +1,21 @@
+// Compile with --pipeline: main and is_even call functions defined further down.
+// returned value should be:   3
+main() {
+   write(is_even(10));
+   putch(10);
+   write(is_even(7));
+   putch(10);
+   return twice(1) + 1;
+}
+
+is_even(n) {
+   if n == 0 { return 1; }
+   return is_odd(n - 1);
+}
+
+is_odd(n) {
+   if n == 0 { return 0; }
+   return is_even(n - 1);
+}
+
+twice(x) { return x * 2; }
@@ -0,0 +1,23 @@
+// Module level globals and constant tables (the tables are read only, in .rodata).
+// should print 5 8 13 0 then 4.
+const N = 4;
+const fib[N * 2] = {1, 1, 2, 3, 5, 8, 13};
+const squares[] = {0, 1, 4, 9, 16};
+let calls;
+let history[N];
+
+lookup(i) {
+   calls = calls + 1;
+   history[calls % N] = i;
+   return fib[i];
+}
+
+main() {
+   write(lookup(4)); putch(32);
+   write(lookup(5)); putch(32);
+   write(lookup(6)); putch(32);
+   write(fib[N + 3]); putch(32);
+   write(calls + len(squares) - squares[2] - history[1] + 4);
+   putch(10);
+   return 0;
+}
@@ -0,0 +1,39 @@
+// Loop hints steer the unroller and vectorizer (see the --report output for whether they were honoured).
+// should print 499500 then 2048.
+sum(a[0]) {
+   let total;
+   total = 0;
+   let i;
+   i = 0;
+   loop unroll(4) vectorize(8) interleave(2) {
+       if i == len(a) { break; }
+       total = total + a[i];
+       i = i + 1;
+   }
+   return total;
+}
+
+main() {
+   let a[1000];
+   let i;
+   i = 0;
+   loop vectorize(1) {
+       if i == 1000 { break; }
+       a[i] = i;
+       i = i + 1;
+   }
+   write(sum(a)); putch(10);
+
+   let b[256];
+   fill(b, 8);
+   let total;
+   total = 0;
+   i = 0;
+   loop unroll(1) {
+       if i == 256 { break; }
+       total = total + b[i];
+       i = i + 1;
+   }
+   write(total); putch(10);
+   return 0;
+}
@@ -0,0 +1,34 @@
+// match dispatches on an integer with a single switch.
+// should print 0 1 1 2 3 9 9 9 9 9 then 42 and -7.
+classify(x) {
+   let kind;
+   match x {
+       0 => { kind = 0; }
+       1 | 2 => { kind = 1 + (x == 2) * 0; }
+       3 => { kind = 2; }
+       -1 => { kind = 3; }
+       _ => { kind = 9; }
+   }
+   return kind;
+}
+
+main() {
+   let i;
+   i = 0;
+   loop {
+       if i == 10 { break; }
+       match i {
+           4 => { write(classify(-1)); }
+           _ => { write(classify(i)); }
+       }
+       putch(32);
+       i = i + 1;
+   }
+   putch(10);
+
+   match 7 { 7 => { write(42); } _ => { write(0); } }
+   putch(32);
+   match i - 17 { -7 => { write(-7); } }
+   putch(10);
+   return 0;
+}
@@ -0,0 +1,45 @@
+// par runs the iterations of [lo, hi) across all cores.
+// should print 499500, 0 and 999 (then 20100 from the nested pars).
+main() {
+   let n;
+   n = 1000;
+
+   let a[1000];
+   par i = 0, n { a[i] = i; }
+
+   let sum;
+   sum = 0;
+   par i = 0, n reduce + sum { sum = sum + a[i]; }
+   write(sum);
+   putch(10);
+
+   let lo;
+   lo = 5;
+   par i = 0, n reduce min lo {
+       if a[i] < lo { lo = a[i]; }
+   }
+   write(lo);
+   putch(10);
+
+   let hi;
+   hi = 0;
+   par i = 0, n reduce max hi {
+       if i % 2 == 0 { continue; }
+       hi = a[i];
+   }
+   write(hi);
+   putch(10);
+
+   let total;
+   total = 0;
+   par i = 0, 200 reduce + total {
+       let row;
+       row = 0;
+       par j = 0, i + 1 reduce + row { row = row + 1; }
+       total = total + row;
+   }
+   write(total);
+   putch(10);
+
+   return 0;
+}
@@ -0,0 +1,46 @@
+// Arrays know their length, also when passed to a function (as a pointer and a length).
+// should print 10 10 45 1 0 7 then 21.
+sum(a[0]) {
+   let total;
+   total = 0;
+   let i;
+   i = 0;
+   loop {
+       if i == len(a) { break; }
+       total = total + a[i];
+       i = i + 1;
+   }
+   return total;
+}
+
+main() {
+   let a[10];
+   let b[10];
+   let i;
+   i = 0;
+   loop {
+       if i == 10 { break; }
+       a[i] = i;
+       i = i + 1;
+   }
+
+   write(len(a)); putch(32);
+   write(copy(b, a)); putch(32);
+   write(sum(b)); putch(32);
+   write(equal(a, b)); putch(32);
+   b[9] = 0;
+   write(equal(a, b)); putch(32);
+
+   let n;
+   n = 4;
+   let c[n + 3];
+   fill(c, 0);
+   write(len(c)); putch(32);
+
+   par j = 0, len(c) { c[j] = j + len(c) - 7; }
+   fill(b, 7);
+   write(sum(c) + b[3] - 7);
+   putch(10);
+
+   return 0;
+}